@@ -0,0 +1,659 @@
+// https://github.com/Flix01/Flix-Tools
+//
+/** MIT License
+ *
+ * Copyright (c) 2020 Flix (https://github.com/Flix01/)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+// Runtime helpers for the .inl files made by pngEmbedder: a single decoder for all the palette
+// encodings but --spans, a cache that decodes the registered images on first access, and a batch
+// decoder that decodes many images concurrently (e.g. at startup).
+//
+// USAGE (in one .c file):
+/*
+#define PNGDECODER_IMPLEMENTATION
+#include "pngDecoder.h"
+
+pngd_Cache* cache = pngd_CacheCreate(16*1024*1024);     // byte budget
+pngd_ImageDesc desc = PNGD_ZERO_INIT;
+desc.name = "tiles";desc.width = width;desc.height = height;desc.encoding = PNGD_ENCODING_CHARS;
+desc.palette = palette;desc.numPalette = sizeof(palette)/sizeof(palette[0]);desc.bytesPerPixel = 4;
+desc.indices = *indices;    // (int modes: desc.indices = indices;desc.numIndices = sizeof(indices)/sizeof(indices[0]);)
+tilesId = pngd_CacheRegister(cache,&desc);
+// [...]
+const unsigned* pixels = (const unsigned*) pngd_CacheGetPixels(cache,tilesId);    // decoded now, or on a previous call
+// [...]
+pngd_CacheDestroy(cache);
+
+// or, to decode all the images at startup (descs[i] as above):
+void* pixels[NUM_IMAGES] = {NULL};     // NULL: use a slice of 'arena'
+void* arena = malloc(pngd_GetBatchArenaSize(descs,NUM_IMAGES));
+pngd_DecodeImages(descs,NUM_IMAGES,pixels,arena,0,NULL,NULL);  // 0 threads: one per core
+*/
+
+#ifndef PNGDECODER_H_
+#define PNGDECODER_H_
+
+#ifndef PNGD_API_DEC
+#   define PNGD_API_DEC extern
+#endif
+#ifndef PNGD_API_DEF
+#   define PNGD_API_DEF /* no-op */
+#endif
+
+#ifndef PNGD_DEBUG
+#   if (!defined(NDEBUG) && !defined(_NDEBUG)) || defined(DEBUG) || defined (_DEBUG)
+#       define PNGD_DEBUG
+#   endif
+#endif
+
+#if (!defined(PNGD_ASSERT) && defined(PNGD_DEBUG))
+#include <assert.h>
+#define PNGD_ASSERT(X)   assert(X)
+#else
+#define PNGD_ASSERT(X)   /*no op*/
+#endif
+
+#ifndef __cplusplus
+#   define PNGD_ZERO_INIT   {0}
+#else
+#   define PNGD_ZERO_INIT   {}
+#endif
+
+#include <stddef.h> // size_t
+
+// How the indices of an .inl file are encoded (see the decoder in its USAGE section)
+enum {
+    PNGD_ENCODING_CHARS=0,      // DecodeImage(...) or DecodeImage8(...):   desc.indices = *indices
+    PNGD_ENCODING_INTS,         // DecodeImageInt(...) or DecodeImageInt8(...)
+    PNGD_ENCODING_1BPP,         // --1bpp
+    PNGD_ENCODING_CHARS_V2,     // --v2:    desc.indices = *indices
+    PNGD_ENCODING_INTS_U8,      // --narrow with DecodeImageIntU8(...)
+    PNGD_ENCODING_INTS_U16,     // --narrow with DecodeImageIntU16(...)
+    PNGD_ENCODING_INTS_U32,     // --narrow with DecodeImageIntU32(...)
+    PNGD_ENCODING_PROGRESSIVE_U8,   // --progressive with DecodeImageProgressiveU8(...) (all the passes at once)
+    PNGD_ENCODING_PROGRESSIVE_U16,  // --progressive with DecodeImageProgressiveU16(...)
+    PNGD_ENCODING_PROGRESSIVE_U32,  // --progressive with DecodeImageProgressiveU32(...)
+    PNGD_ENCODING_QUADTREE_U8,      // --quadtree with DecodeImageQuadtreeU8(...)
+    PNGD_ENCODING_QUADTREE_U16,     // --quadtree with DecodeImageQuadtreeU16(...)
+    PNGD_ENCODING_COUNT
+};
+// (--spans is not here: its BlitSprite(...) draws into a larger image)
+
+// The order of the indices (the 'scanOrder' of an .inl file made with --scan): the pixels are written straight
+// to their place, without the temporary buffer and the UnscanImage(...) pass of the USAGE section
+enum {
+    PNGD_SCAN_ORDER_ROW=0,
+    PNGD_SCAN_ORDER_COLUMN,
+    PNGD_SCAN_ORDER_SERPENTINE,
+    PNGD_SCAN_ORDER_HILBERT,
+    PNGD_SCAN_ORDER_COUNT
+};
+
+typedef struct {
+    const char* name;           // (optional) used by pngd_CacheFind(...)
+    int width,height;
+    int encoding;               // PNGD_ENCODING_
+    const void* palette;        // 'palette' of the .inl file
+    int numPalette;             // sizeof(palette)/sizeof(palette[0])
+    int bytesPerPixel;          // 4 (RGBA palette) or 1 (8-bit palette made with --8bit)
+    const void* indices;
+    size_t numIndices;          // sizeof(indices)/sizeof(indices[0]) (int modes only)
+    int scanOrder;              // PNGD_SCAN_ORDER_ ('scanOrder' of the .inl file, 0 if it has none; ignored by progressive and quadtree)
+} pngd_ImageDesc;
+
+// 'pPixelsOut' must be width*height*bytesPerPixel bytes
+PNGD_API_DEC void pngd_DecodeImage(void* pPixelsOut,const pngd_ImageDesc* desc);
+
+
+// Decode-on-demand cache: images are decoded on first access and the least recently used ones are
+// freed when 'byteBudget' is exceeded (they are decoded again transparently when needed).
+// A pointer returned by pngd_CacheGetPixels(...) is valid until the next call that can evict images
+// (pngd_CacheGetPixels(...) of a non-resident image or pngd_CacheSetBudget(...)).
+// An image bigger than the whole budget is still decoded (and it is the first to be evicted).
+// The cache is not thread-safe.
+typedef struct pngd_Cache pngd_Cache;
+typedef struct {
+    size_t numHits,numMisses,numEvictions;
+    double decodeTimeMs;        // total time spent decoding
+    size_t bytesResident,peakBytesResident,byteBudget;
+    int numImages,numImagesResident;
+} pngd_CacheStats;
+
+PNGD_API_DEC pngd_Cache* pngd_CacheCreate(size_t byteBudget);
+PNGD_API_DEC void pngd_CacheDestroy(pngd_Cache* cache);
+// 'desc' is copied, but 'name', 'palette' and 'indices' must stay valid. Returns the image id (or -1)
+PNGD_API_DEC int pngd_CacheRegister(pngd_Cache* cache,const pngd_ImageDesc* desc);
+PNGD_API_DEC int pngd_CacheFind(const pngd_Cache* cache,const char* name);  // linear search: better store the id
+PNGD_API_DEC const void* pngd_CacheGetPixels(pngd_Cache* cache,int id);    // NULL if out of memory
+PNGD_API_DEC void pngd_CacheSetBudget(pngd_Cache* cache,size_t byteBudget);
+PNGD_API_DEC void pngd_CacheGetStats(const pngd_Cache* cache,pngd_CacheStats* stats);
+
+
+// Batch decoding: decodes 'numImages' images concurrently on 'numThreads' threads (<=0: one per core), the calling thread included.
+// Images are never split: a batch is as fast as its biggest image. Needs -lpthread (or define PNGD_NO_THREADS).
+// If 'pixelsOut[i]' is NULL, it's set to a slice of 'arena', that must be at least pngd_GetBatchArenaSize(...) bytes.
+// 'callback' (optional) is called (by the worker thread) as soon as an image has been decoded. Returns 0 if out of memory.
+typedef void (*pngd_ImageDecodedCallback)(int imageIndex,void* pixels,void* userData);
+PNGD_API_DEC size_t pngd_GetBatchArenaSize(const pngd_ImageDesc* descs,int numImages);
+PNGD_API_DEC int pngd_DecodeImages(const pngd_ImageDesc* descs,int numImages,void** pixelsOut,void* arena,int numThreads,pngd_ImageDecodedCallback callback,void* userData);
+
+#ifndef PNGD_MALLOC
+#   include <stdlib.h>
+#   define PNGD_MALLOC(X)  malloc(X)
+#endif
+#ifndef PNGD_REALLOC
+#   include <stdlib.h>
+#   define PNGD_REALLOC(X,Y)  realloc(X,Y)
+#endif
+#ifndef PNGD_FREE
+#   include <stdlib.h>
+#   define PNGD_FREE(X)  free(X)
+#endif
+
+#endif // PNGDECODER_H_
+
+
+
+#ifdef PNGDECODER_IMPLEMENTATION
+#ifndef PNGDECODER_IMPLEMENTATION_GUARD
+#define PNGDECODER_IMPLEMENTATION_GUARD
+
+#include <string.h>
+#include <stdlib.h> // qsort
+#ifndef PNGD_NO_THREADS
+#   ifdef _WIN32
+#       include <windows.h>
+#   else
+#       include <pthread.h>
+#       include <unistd.h> // sysconf
+#   endif
+#endif
+#ifndef PNGD_GET_TIME_MS
+#   ifdef _WIN32
+#       include <windows.h>
+#   else
+#       include <time.h>
+#   endif
+static double pngd_GetTimeMs(void) {   // monotonic wall clock (clock() would count the CPU time of all the threads)
+#   ifdef _WIN32
+    LARGE_INTEGER counter,frequency;
+    QueryPerformanceCounter(&counter);QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart*1000.0/(double)frequency.QuadPart;
+#   else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec*1000.0+(double)ts.tv_nsec/1000000.0;
+#   endif
+}
+#   define PNGD_GET_TIME_MS()   pngd_GetTimeMs()
+#endif
+
+
+// Every decoder writes runs of palette colors through this
+typedef struct {
+    unsigned* p32;const unsigned* palette32;
+    unsigned char* p8;const unsigned char* palette8;
+    size_t numLeft;
+    int scanOrder,width,height,x,y,pass;    // (not row-major: p32 or p8 stay at the first pixel)
+    unsigned char curve[256][2];            // PNGD_SCAN_ORDER_HILBERT: (x,y) in a 16x16 tile
+} pngd_Output;
+#define PNGD_SCAN_ORDER_ADAM7   (PNGD_SCAN_ORDER_COUNT)     // (the order of the progressive modes)
+static const unsigned char pngd_adam7Passes[7][4] = {{0,0,8,8},{4,0,8,8},{0,4,4,8},{2,0,4,4},{0,2,2,4},{1,0,2,2},{0,1,1,2}};  // x0,y0,dx,dy
+static void pngd_InitScanOrder(pngd_Output* o,int scanOrder,int width,int height) {
+    int d,s,t,rx,ry,tmp,x,y;
+    o->scanOrder = scanOrder;o->width = width;o->height = height;o->x = o->y = o->pass = 0;
+    if (scanOrder!=PNGD_SCAN_ORDER_HILBERT) return;
+    for (d=0;d<256;d++) {
+        for (s=1,t=d,x=y=0;s<16;s*=2,t/=4) {
+            rx = 1&(t/2);ry = 1&(t^rx);
+            if (ry==0) {if (rx==1) {x=s-1-x;y=s-1-y;} tmp=x;x=y;y=tmp;}
+            x+=s*rx;y+=s*ry;
+        }
+        o->curve[d][0]=(unsigned char)x;o->curve[d][1]=(unsigned char)y;
+    }
+}
+// Returns the offset of the next pixel in the scan order (for PNGD_SCAN_ORDER_HILBERT, x,y is the tile and pass the position along its curve)
+static size_t pngd_NextScanOffset(pngd_Output* o) {
+    const int w = o->width, h = o->height;int x,y;
+    switch (o->scanOrder) {
+    case PNGD_SCAN_ORDER_COLUMN:
+        x = o->x;y = o->y;
+        if (++o->y==h) {o->y=0;++o->x;}
+        break;
+    case PNGD_SCAN_ORDER_SERPENTINE:
+        x = (o->y&1) ? w-1-o->x : o->x;y = o->y;
+        if (++o->x==w) {o->x=0;++o->y;}
+        break;
+    case PNGD_SCAN_ORDER_HILBERT:
+        do {
+            x = o->x+o->curve[o->pass][0];y = o->y+o->curve[o->pass][1];
+            if (++o->pass==256) {o->pass=0;o->x+=16;if (o->x>=w) {o->x=0;o->y+=16;}}
+        } while (x>=w || y>=h);     // (pixels outside the image are skipped)
+        break;
+    default:    // PNGD_SCAN_ORDER_ADAM7
+        while (o->pass<6 && (pngd_adam7Passes[o->pass][0]>=w || pngd_adam7Passes[o->pass][1]>=h)) ++o->pass;   // (empty passes of small images)
+        x = o->x+pngd_adam7Passes[o->pass][0];y = o->y+pngd_adam7Passes[o->pass][1];
+        o->x+=pngd_adam7Passes[o->pass][2];
+        if (x+pngd_adam7Passes[o->pass][2]>=w) {
+            o->x=0;o->y+=pngd_adam7Passes[o->pass][3];
+            if (y+pngd_adam7Passes[o->pass][3]>=h) {o->y=0;++o->pass;}
+        }
+        break;
+    }
+    return (size_t)y*(size_t)w+(size_t)x;
+}
+static void pngd_PutRun(pngd_Output* o,unsigned index,size_t count) {
+    PNGD_ASSERT(count<=o->numLeft);
+    if (count>o->numLeft) count = o->numLeft;
+    o->numLeft-=count;
+    if (o->scanOrder!=PNGD_SCAN_ORDER_ROW) {
+        if (o->palette32) {const unsigned c = o->palette32[index];while (count--) o->p32[pngd_NextScanOffset(o)] = c;}
+        else {const unsigned char c = o->palette8[index];while (count--) o->p8[pngd_NextScanOffset(o)] = c;}
+    }
+    else if (o->palette32) {const unsigned c = o->palette32[index];unsigned* p = o->p32;while (count--) *p++ = c;o->p32 = p;}
+    else {memset(o->p8,o->palette8[index],count);o->p8+=count;}
+}
+// Fills a rectangle of the image (p32 or p8 stay at the first pixel)
+static void pngd_PutRect(pngd_Output* o,unsigned index,int x,int y,int w,int h) {
+    const size_t offset = (size_t)y*(size_t)o->width+(size_t)x;int i,j;
+    PNGD_ASSERT((size_t)w*(size_t)h<=o->numLeft);
+    o->numLeft-=(size_t)w*(size_t)h;
+    if (o->palette32) {
+        const unsigned c = o->palette32[index];unsigned* p = &o->p32[offset];
+        for (j=0;j<h;j++,p+=o->width) {for (i=0;i<w;i++) p[i] = c;}
+    }
+    else {
+        unsigned char* p = &o->p8[offset];
+        for (j=0;j<h;j++,p+=o->width) memset(p,o->palette8[index],(size_t)w);
+    }
+}
+
+static void pngd_DecodeChars(pngd_Output* o,const char* indices) {
+    const char* pc;int c,lastIdx=0,hasReps=0;
+    for (pc=indices;*pc!='\0' && o->numLeft>0;++pc)  {
+        c = *pc;if (!hasReps && c=='~') {hasReps=1;continue;}
+        c = c>='\\' ? (c-'1') : (c-'0');
+        if (hasReps) {pngd_PutRun(o,(unsigned)lastIdx,(size_t)c);hasReps=0;continue;}
+        pngd_PutRun(o,(unsigned)c,1);lastIdx = c;
+    }
+}
+static void pngd_DecodeInts(pngd_Output* o,const int* indices,size_t numIndices) {
+    size_t i;int lastIdx=0;
+    for (i=0;i<numIndices;i++)  {
+        if (indices[i]<0) pngd_PutRun(o,(unsigned)lastIdx,(size_t)(-indices[i]));
+        else {lastIdx = indices[i];pngd_PutRun(o,(unsigned)lastIdx,1);}
+    }
+}
+static void pngd_Decode1bpp(pngd_Output* o,const unsigned char* indices,int width,int height) {
+    const int numBytesPerRow = (width+7)/8;
+    int x=0,y=0,k,numReps=0;unsigned char b=0;
+    while (y<height) {
+        if (numReps>0) --numReps;
+        else {b = *indices++;if (b==0x00 || b==0xFF) numReps = (int)(*indices++)-1;}
+        if (b==0x00 || b==0xFF) pngd_PutRun(o,b&1,(size_t)(x<numBytesPerRow-1 ? 8 : width-8*x));
+        else for (k=0;k<8 && x*8+k<width;k++) pngd_PutRun(o,(b>>(7-k))&1,1);
+        if (++x==numBytesPerRow) {x=0;++y;}
+    }
+}
+static void pngd_DecodeCharsV2(pngd_Output* o,const char* indices) {
+    // symbol value: '!'..'~' without '"', ':', '?' and '\\'
+#   define PNGD_V2_SYMBOL(C) ((unsigned)(C)-33U-((C)>'"')-((C)>':')-((C)>'?')-((C)>'\\'))
+    const unsigned char* pc = (const unsigned char*) indices;
+    unsigned idx=0,v,numDirect,mul;size_t numReps;
+    if (*pc!='2') return;   // version
+    numDirect = PNGD_V2_SYMBOL(pc[1]);pc+=2;
+    while (*pc)  {
+        v = PNGD_V2_SYMBOL(*pc);++pc;
+        if (v<numDirect) idx = v;
+        else if (v<89) {idx = numDirect+(v-numDirect)*90+PNGD_V2_SYMBOL(*pc);++pc;}
+        else {
+            numReps=1;mul=1;
+            do {v = PNGD_V2_SYMBOL(*pc);++pc;numReps+=(v>=45?v-45:v)*mul;mul*=45;} while (v>=45);
+            pngd_PutRun(o,idx,numReps);
+            continue;
+        }
+        pngd_PutRun(o,idx,1);
+    }
+#   undef PNGD_V2_SYMBOL
+}
+// Quadtree (--quadtree): 64x64 blocks in row-major order, each one a tree where 'numPalette' splits a node into 4 children
+#define PNGD_DECODE_QUADTREE_NODE(NAME,TYPE)                                                            \
+static const TYPE* NAME(pngd_Output* o,int x,int y,int size,unsigned numPalette,const TYPE* indices) {   \
+    if (*indices==numPalette) {                                                                         \
+        const int half = size/2;                                                                        \
+        indices = NAME(o,x,y,half,numPalette,indices+1);                                                \
+        if (x+half<o->width) indices = NAME(o,x+half,y,half,numPalette,indices);                        \
+        if (y+half<o->height) {                                                                         \
+            indices = NAME(o,x,y+half,half,numPalette,indices);                                         \
+            if (x+half<o->width) indices = NAME(o,x+half,y+half,half,numPalette,indices);               \
+        }                                                                                               \
+        return indices;                                                                                 \
+    }                                                                                                   \
+    pngd_PutRect(o,*indices,x,y,x+size<o->width ? size : o->width-x,y+size<o->height ? size : o->height-y);  \
+    return indices+1;                                                                                   \
+}
+PNGD_DECODE_QUADTREE_NODE(pngd_DecodeQuadtreeNodeU8,unsigned char)
+PNGD_DECODE_QUADTREE_NODE(pngd_DecodeQuadtreeNodeU16,unsigned short)
+#undef PNGD_DECODE_QUADTREE_NODE
+#define PNGD_DECODE_QUADTREE(NODE,TYPE)   {                                                             \
+    const TYPE* ind = (const TYPE*) desc->indices;int x,y;                                              \
+    for (y=0;y<desc->height;y+=64) {                                                                    \
+        for (x=0;x<desc->width;x+=64) ind = NODE(&o,x,y,64,(unsigned)desc->numPalette,ind);             \
+    }                                                                                                   \
+}
+#define PNGD_DECODE_INTS_NARROW(TYPE)   {                                                               \
+    const TYPE* ind = (const TYPE*) desc->indices;size_t i;unsigned idx=0;                              \
+    for (i=0;i<desc->numIndices;i++)  {                                                                 \
+        if ((unsigned)ind[i]!=(unsigned)desc->numPalette) {idx = (unsigned)ind[i];pngd_PutRun(&o,idx,1);}   \
+        else pngd_PutRun(&o,idx,(size_t)ind[++i]);  /* 'numPalette' is followed by the number of further repetitions */ \
+    }                                                                                                   \
+}
+
+PNGD_API_DEF void pngd_DecodeImage(void* pPixelsOut,const pngd_ImageDesc* desc) {
+    pngd_Output o;
+    PNGD_ASSERT(pPixelsOut && desc && desc->palette && desc->indices);
+    PNGD_ASSERT(desc->bytesPerPixel==4 || desc->bytesPerPixel==1);
+    o.p32 = NULL;o.palette32 = NULL;o.p8 = NULL;o.palette8 = NULL;
+    o.numLeft = (size_t)desc->width*(size_t)desc->height;
+    if (desc->bytesPerPixel==4) {o.p32 = (unsigned*) pPixelsOut;o.palette32 = (const unsigned*) desc->palette;}
+    else {o.p8 = (unsigned char*) pPixelsOut;o.palette8 = (const unsigned char*) desc->palette;}
+    PNGD_ASSERT(desc->scanOrder>=0 && desc->scanOrder<PNGD_SCAN_ORDER_COUNT);
+    if (desc->encoding>=PNGD_ENCODING_PROGRESSIVE_U8 && desc->encoding<=PNGD_ENCODING_PROGRESSIVE_U32) pngd_InitScanOrder(&o,PNGD_SCAN_ORDER_ADAM7,desc->width,desc->height);
+    else if (desc->encoding==PNGD_ENCODING_QUADTREE_U8 || desc->encoding==PNGD_ENCODING_QUADTREE_U16) pngd_InitScanOrder(&o,PNGD_SCAN_ORDER_ROW,desc->width,desc->height);
+    else pngd_InitScanOrder(&o,desc->scanOrder,desc->width,desc->height);
+    switch (desc->encoding) {
+    case PNGD_ENCODING_CHARS:       pngd_DecodeChars(&o,(const char*) desc->indices);break;
+    case PNGD_ENCODING_INTS:        pngd_DecodeInts(&o,(const int*) desc->indices,desc->numIndices);break;
+    case PNGD_ENCODING_1BPP:        pngd_Decode1bpp(&o,(const unsigned char*) desc->indices,desc->width,desc->height);break;
+    case PNGD_ENCODING_CHARS_V2:    pngd_DecodeCharsV2(&o,(const char*) desc->indices);break;
+    case PNGD_ENCODING_INTS_U8:     PNGD_DECODE_INTS_NARROW(unsigned char);break;
+    case PNGD_ENCODING_INTS_U16:    PNGD_DECODE_INTS_NARROW(unsigned short);break;
+    case PNGD_ENCODING_INTS_U32:    PNGD_DECODE_INTS_NARROW(unsigned int);break;
+    case PNGD_ENCODING_PROGRESSIVE_U8:  PNGD_DECODE_INTS_NARROW(unsigned char);break;     // (the narrow ints in Adam7 order)
+    case PNGD_ENCODING_PROGRESSIVE_U16: PNGD_DECODE_INTS_NARROW(unsigned short);break;
+    case PNGD_ENCODING_PROGRESSIVE_U32: PNGD_DECODE_INTS_NARROW(unsigned int);break;
+    case PNGD_ENCODING_QUADTREE_U8:     PNGD_DECODE_QUADTREE(pngd_DecodeQuadtreeNodeU8,unsigned char);break;
+    case PNGD_ENCODING_QUADTREE_U16:    PNGD_DECODE_QUADTREE(pngd_DecodeQuadtreeNodeU16,unsigned short);break;
+    default: PNGD_ASSERT(0);break;
+    }
+    PNGD_ASSERT(o.numLeft==0);
+}
+#undef PNGD_DECODE_INTS_NARROW
+#undef PNGD_DECODE_QUADTREE
+
+
+// The resident images are kept in a doubly linked list, from the most recently used one ('head')
+typedef struct {
+    pngd_ImageDesc desc;
+    void* pixels;
+    size_t size;
+    int prev,next;
+} pngd_CacheEntry;
+struct pngd_Cache {
+    pngd_CacheEntry* entries;
+    int numEntries,capacity;
+    int head,tail;
+    pngd_CacheStats stats;
+};
+
+PNGD_API_DEF pngd_Cache* pngd_CacheCreate(size_t byteBudget) {
+    pngd_Cache* c = (pngd_Cache*) PNGD_MALLOC(sizeof(pngd_Cache));
+    if (!c) return NULL;
+    memset(c,0,sizeof(*c));
+    c->head = c->tail = -1;
+    c->stats.byteBudget = byteBudget;
+    return c;
+}
+PNGD_API_DEF void pngd_CacheDestroy(pngd_Cache* c) {
+    int i;
+    if (!c) return;
+    for (i=0;i<c->numEntries;i++) {if (c->entries[i].pixels) PNGD_FREE(c->entries[i].pixels);}
+    if (c->entries) PNGD_FREE(c->entries);
+    PNGD_FREE(c);
+}
+PNGD_API_DEF int pngd_CacheRegister(pngd_Cache* c,const pngd_ImageDesc* desc) {
+    pngd_CacheEntry* e;
+    PNGD_ASSERT(c && desc);
+    if (c->numEntries==c->capacity) {
+        const int newCapacity = c->capacity<16 ? 16 : c->capacity*2;
+        pngd_CacheEntry* newEntries = (pngd_CacheEntry*) PNGD_REALLOC(c->entries,newCapacity*sizeof(pngd_CacheEntry));
+        if (!newEntries) return -1;
+        c->entries = newEntries;c->capacity = newCapacity;
+    }
+    e = &c->entries[c->numEntries];
+    e->desc = *desc;e->pixels = NULL;e->size = (size_t)desc->width*(size_t)desc->height*(size_t)desc->bytesPerPixel;
+    e->prev = e->next = -1;
+    c->stats.numImages = c->numEntries+1;
+    return c->numEntries++;
+}
+PNGD_API_DEF int pngd_CacheFind(const pngd_Cache* c,const char* name) {
+    int i;
+    for (i=0;i<c->numEntries;i++) {if (c->entries[i].desc.name && strcmp(c->entries[i].desc.name,name)==0) return i;}
+    return -1;
+}
+static void pngd_CacheUnlink(pngd_Cache* c,int id) {
+    pngd_CacheEntry* e = &c->entries[id];
+    if (e->prev>=0) c->entries[e->prev].next = e->next;
+    else c->head = e->next;
+    if (e->next>=0) c->entries[e->next].prev = e->prev;
+    else c->tail = e->prev;
+    e->prev = e->next = -1;
+}
+static void pngd_CacheLinkFront(pngd_Cache* c,int id) {
+    pngd_CacheEntry* e = &c->entries[id];
+    e->prev = -1;e->next = c->head;
+    if (c->head>=0) c->entries[c->head].prev = id;
+    c->head = id;
+    if (c->tail<0) c->tail = id;
+}
+// Frees the least recently used images until 'extraSize' more bytes fit in the budget
+static void pngd_CacheEvict(pngd_Cache* c,size_t extraSize) {
+    while (c->tail>=0 && c->stats.bytesResident+extraSize>c->stats.byteBudget) {
+        const int id = c->tail;pngd_CacheEntry* e = &c->entries[id];
+        pngd_CacheUnlink(c,id);
+        PNGD_FREE(e->pixels);e->pixels = NULL;
+        c->stats.bytesResident-=e->size;
+        --c->stats.numImagesResident;
+        ++c->stats.numEvictions;
+    }
+}
+PNGD_API_DEF const void* pngd_CacheGetPixels(pngd_Cache* c,int id) {
+    pngd_CacheEntry* e;double startTime;
+    PNGD_ASSERT(c && id>=0 && id<c->numEntries);
+    if (id<0 || id>=c->numEntries) return NULL;
+    e = &c->entries[id];
+    if (e->pixels) {
+        ++c->stats.numHits;
+        if (c->head!=id) {pngd_CacheUnlink(c,id);pngd_CacheLinkFront(c,id);}
+        return e->pixels;
+    }
+    ++c->stats.numMisses;
+    pngd_CacheEvict(c,e->size);
+    e->pixels = PNGD_MALLOC(e->size);
+    if (!e->pixels) return NULL;
+    startTime = PNGD_GET_TIME_MS();
+    pngd_DecodeImage(e->pixels,&e->desc);
+    c->stats.decodeTimeMs+=PNGD_GET_TIME_MS()-startTime;
+    pngd_CacheLinkFront(c,id);
+    c->stats.bytesResident+=e->size;
+    ++c->stats.numImagesResident;
+    if (c->stats.peakBytesResident<c->stats.bytesResident) c->stats.peakBytesResident = c->stats.bytesResident;
+    return e->pixels;
+}
+PNGD_API_DEF void pngd_CacheSetBudget(pngd_Cache* c,size_t byteBudget) {
+    c->stats.byteBudget = byteBudget;
+    pngd_CacheEvict(c,0);
+}
+PNGD_API_DEF void pngd_CacheGetStats(const pngd_Cache* c,pngd_CacheStats* stats) {*stats = c->stats;}
+
+
+
+// Batch decoding: every thread has its own queue of images (the biggest ones first), and steals from the back of the other
+// queues when its own is empty. A queue is a range of 'items' protected by a mutex (images are never added to a queue).
+#ifndef PNGD_NO_THREADS
+#   ifdef _WIN32
+typedef CRITICAL_SECTION pngd_Mutex;
+#       define pngd_MutexInit(M)    InitializeCriticalSection(M)
+#       define pngd_MutexDestroy(M) DeleteCriticalSection(M)
+#       define pngd_MutexLock(M)    EnterCriticalSection(M)
+#       define pngd_MutexUnlock(M)  LeaveCriticalSection(M)
+#   else
+typedef pthread_mutex_t pngd_Mutex;
+#       define pngd_MutexInit(M)    pthread_mutex_init(M,NULL)
+#       define pngd_MutexDestroy(M) pthread_mutex_destroy(M)
+#       define pngd_MutexLock(M)    pthread_mutex_lock(M)
+#       define pngd_MutexUnlock(M)  pthread_mutex_unlock(M)
+#   endif
+#else
+typedef int pngd_Mutex;
+#   define pngd_MutexInit(M)    /* no-op */
+#   define pngd_MutexDestroy(M) /* no-op */
+#   define pngd_MutexLock(M)    /* no-op */
+#   define pngd_MutexUnlock(M)  /* no-op */
+#endif
+#define PNGD_MAX_NUM_THREADS    (64)
+#define PNGD_ARENA_ALIGNMENT    (16)
+
+typedef struct {
+    const int* items;
+    int head,tail;      // [head,tail)
+    pngd_Mutex mutex;
+} pngd_JobQueue;
+typedef struct {
+    const pngd_ImageDesc* descs;
+    void** pixelsOut;
+    pngd_JobQueue* queues;
+    int numQueues;
+    pngd_ImageDecodedCallback callback;
+    void* userData;
+} pngd_Batch;
+typedef struct {
+    pngd_Batch* batch;
+    int queueIndex;
+} pngd_Worker;
+typedef struct {
+    size_t size;
+    int index;
+} pngd_BatchItem;
+
+static int pngd_GetNumHardwareThreads(void) {
+#   ifdef PNGD_NO_THREADS
+    return 1;
+#   elif defined(_WIN32)
+    SYSTEM_INFO si;GetSystemInfo(&si);
+    return (int) si.dwNumberOfProcessors;
+#   else
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n>0 ? (int) n : 1;
+#   endif
+}
+static int pngd_BatchItemCmp(const void* pa,const void* pb) {     // bigger images first
+    const pngd_BatchItem* a = (const pngd_BatchItem*) pa;const pngd_BatchItem* b = (const pngd_BatchItem*) pb;
+    if (a->size!=b->size) return a->size>b->size ? -1 : 1;
+    return a->index-b->index;
+}
+static int pngd_JobQueuePop(pngd_JobQueue* q,int fromBack) {
+    int item = -1;
+    pngd_MutexLock(&q->mutex);
+    if (q->head<q->tail) item = fromBack ? q->items[--q->tail] : q->items[q->head++];
+    pngd_MutexUnlock(&q->mutex);
+    return item;
+}
+static void pngd_WorkerRun(pngd_Worker* w) {
+    pngd_Batch* b = w->batch;int item,k;
+    for (;;) {
+        item = pngd_JobQueuePop(&b->queues[w->queueIndex],0);
+        for (k=1;item<0 && k<b->numQueues;k++) item = pngd_JobQueuePop(&b->queues[(w->queueIndex+k)%b->numQueues],1);   // steal
+        if (item<0) break;  // all the queues are empty
+        pngd_DecodeImage(b->pixelsOut[item],&b->descs[item]);
+        if (b->callback) b->callback(item,b->pixelsOut[item],b->userData);
+    }
+}
+#ifndef PNGD_NO_THREADS
+#   ifdef _WIN32
+static DWORD WINAPI pngd_WorkerThreadProc(LPVOID p) {pngd_WorkerRun((pngd_Worker*)p);return 0;}
+#   else
+static void* pngd_WorkerThreadProc(void* p) {pngd_WorkerRun((pngd_Worker*)p);return NULL;}
+#   endif
+#endif
+
+PNGD_API_DEF size_t pngd_GetBatchArenaSize(const pngd_ImageDesc* descs,int numImages) {
+    size_t total = 0;int i;
+    for (i=0;i<numImages;i++) total+=((size_t)descs[i].width*(size_t)descs[i].height*(size_t)descs[i].bytesPerPixel+PNGD_ARENA_ALIGNMENT-1)/PNGD_ARENA_ALIGNMENT*PNGD_ARENA_ALIGNMENT;
+    return total;
+}
+PNGD_API_DEF int pngd_DecodeImages(const pngd_ImageDesc* descs,int numImages,void** pixelsOut,void* arena,int numThreads,pngd_ImageDecodedCallback callback,void* userData) {
+    pngd_Batch b;pngd_Worker workers[PNGD_MAX_NUM_THREADS];pngd_JobQueue queues[PNGD_MAX_NUM_THREADS];
+    pngd_BatchItem* sorted;int* items;int i,q,numItems;size_t arenaOffset = 0;
+    PNGD_ASSERT(descs && pixelsOut && numImages>=0);
+    if (numImages<=0) return 1;
+    if (numThreads<=0) numThreads = pngd_GetNumHardwareThreads();
+    if (numThreads>PNGD_MAX_NUM_THREADS) numThreads = PNGD_MAX_NUM_THREADS;
+    if (numThreads>numImages) numThreads = numImages;
+#   ifdef PNGD_NO_THREADS
+    numThreads = 1;
+#   endif
+    sorted = (pngd_BatchItem*) PNGD_MALLOC(numImages*sizeof(pngd_BatchItem));
+    items = (int*) PNGD_MALLOC(numImages*sizeof(int));
+    if (!sorted || !items) {if (sorted) PNGD_FREE(sorted);if (items) PNGD_FREE(items);return 0;}
+    for (i=0;i<numImages;i++) {
+        sorted[i].size = (size_t)descs[i].width*(size_t)descs[i].height*(size_t)descs[i].bytesPerPixel;sorted[i].index = i;
+        if (!pixelsOut[i]) {
+            PNGD_ASSERT(arena);
+            pixelsOut[i] = (void*) ((unsigned char*) arena + arenaOffset);
+            arenaOffset+=(sorted[i].size+PNGD_ARENA_ALIGNMENT-1)/PNGD_ARENA_ALIGNMENT*PNGD_ARENA_ALIGNMENT;
+        }
+    }
+    qsort(sorted,numImages,sizeof(pngd_BatchItem),&pngd_BatchItemCmp);
+    // queue q gets the images sorted[q], sorted[q+numThreads], ...
+    for (q=0,numItems=0;q<numThreads;q++) {
+        queues[q].items = &items[numItems];queues[q].head = 0;queues[q].tail = 0;
+        for (i=q;i<numImages;i+=numThreads) items[numItems+queues[q].tail++] = sorted[i].index;
+        numItems+=queues[q].tail;
+        pngd_MutexInit(&queues[q].mutex);
+    }
+    b.descs = descs;b.pixelsOut = pixelsOut;b.queues = queues;b.numQueues = numThreads;b.callback = callback;b.userData = userData;
+    for (q=0;q<numThreads;q++) {workers[q].batch = &b;workers[q].queueIndex = q;}
+#   ifndef PNGD_NO_THREADS
+    {
+#       ifdef _WIN32
+        HANDLE threads[PNGD_MAX_NUM_THREADS];
+        for (q=1;q<numThreads;q++) threads[q] = CreateThread(NULL,0,&pngd_WorkerThreadProc,&workers[q],0,NULL);
+        pngd_WorkerRun(&workers[0]);    // the calling thread works too
+        for (q=1;q<numThreads;q++) {if (threads[q]) {WaitForSingleObject(threads[q],INFINITE);CloseHandle(threads[q]);}}
+#       else
+        pthread_t threads[PNGD_MAX_NUM_THREADS];int started[PNGD_MAX_NUM_THREADS];
+        for (q=1;q<numThreads;q++) started[q] = pthread_create(&threads[q],NULL,&pngd_WorkerThreadProc,&workers[q])==0;
+        pngd_WorkerRun(&workers[0]);    // the calling thread works too (and steals the queues of threads that could not start)
+        for (q=1;q<numThreads;q++) {if (started[q]) pthread_join(threads[q],NULL);}
+#       endif
+    }
+#   else
+    pngd_WorkerRun(&workers[0]);
+#   endif
+    for (q=0;q<numThreads;q++) pngd_MutexDestroy(&queues[q].mutex);
+    PNGD_FREE(items);PNGD_FREE(sorted);
+    return 1;
+}
+
+#endif //PNGDECODER_IMPLEMENTATION_GUARD
+#endif //PNGDECODER_IMPLEMENTATION
@@ -111,6 +111,11 @@ int main (int argc,char* argv[])
         1) Compact: indices are stored as chars (if the number of colors in the image is less than about 76 AFAIR)
         2) Larger: indices are stored as integers (not recommended)
         Use DecodeImage(...) for (1) and DecodeImageInt(...) for (2)
+        (if the .inl file has an 8-bit palette, see pngEmbedder --8bit, use the DecodeImage8(...) or DecodeImageInt8(...) in its USAGE section)
+        3) Two-color images saved with pngEmbedder --1bpp: use the DecodeImage1bpp(...) (or DecodeImage1bpp8(...)) in the USAGE section of the .inl file
+        4) Images saved with pngEmbedder --v2 (up to 4096 colors): use the DecodeImageV2(...) (or DecodeImageV2_8(...)) in the USAGE section of the .inl file
+        5) Images saved with pngEmbedder --narrow: use the DecodeImageIntU8/U16/U32(...) in the USAGE section of the .inl file
+        (testDecoder.c checks that the .inl files of these modes, RGBA palettes only, decode back to their images)
     */
     unsigned int raw[width*height];
     DecodeImage(&raw[0],palette,sizeof(palette)/sizeof(palette[0]),*indices);
@@ -0,0 +1,149 @@
+// https://github.com/Flix01/Flix-Tools
+//
+// Round-trip check of pngDecoder.h: pngd_DecodeImage(...) must give back the pixels of the image an .inl file was made from
+// (RGBA palettes only: don't use --8bit, --trim or --tiles).
+// Then the same image goes through pngd_Cache (hit, miss and eviction counts) and pngd_DecodeImages(...) (with 1 thread and
+// with one per core), that must give the same pixels as pngd_DecodeImage(...).
+//
+// TO COMPILE THIS ON LINUX (once per .inl file, e.g. made with: ../pngEmbedder --quadtree ../Tile8x8.png):
+//
+// gcc -Os -no-pie -DINL_FILE=\"../Tile8x8.png.inl\" -DENCODING=PNGD_ENCODING_QUADTREE_U8 testDecoder.c -o testDecoder -lpthread -lm
+// ./testDecoder ../Tile8x8.png
+//
+// ENCODING is the PNGD_ENCODING_ of the decoder in the USAGE section of the .inl file (e.g. DecodeImageQuadtreeU8(...)),
+// and with --scan add -DSCANNED (the .inl file then has 'scanOrder').
+//
+
+#define PNGDECODER_IMPLEMENTATION
+#include "pngDecoder.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef INL_FILE
+#   error "Define INL_FILE (e.g. -DINL_FILE=\"../Tile8x8.png.inl\")"
+#endif
+#ifndef ENCODING
+#   error "Define ENCODING (e.g. -DENCODING=PNGD_ENCODING_CHARS)"
+#endif
+
+#define NUM_BATCH_IMAGES (6)    // the odd ones use an inverted copy of the palette, so that swapped outputs are caught
+
+static int numFailures = 0;
+static void Check(int ok,const char* what) {
+    printf("%-80s %s\n",what,ok ? "OK" : "FAILED");
+    if (!ok) ++numFailures;
+}
+
+static void OnImageDecoded(int imageIndex,void* pixels,void* userData) {
+    (void)pixels;
+    ((int*)userData)[imageIndex]+=1;    // (each image has its own counter: no lock needed)
+}
+
+// pngd_Cache: 3 copies of the image, with a budget of 2: the sequence below gives 2 hits, 4 misses and 2 evictions
+static void CheckCache(const pngd_ImageDesc* desc,const unsigned* reference) {
+    const size_t size = (size_t)desc->width*desc->height*sizeof(unsigned);
+    static const char* names[3] = {"a","b","c"};
+    static const int sequence[6] = {0,0,1,2,0,2};  // 0 miss, 0 hit, 1 miss, 2 miss (evicts 0), 0 miss (evicts 1), 2 hit
+    pngd_Cache* cache = pngd_CacheCreate(2*size);
+    pngd_CacheStats stats;int ids[3],i,samePixels = 1;
+    if (!cache) {Check(0,"pngd_CacheCreate(...)");return;}
+    for (i=0;i<3;i++) {
+        pngd_ImageDesc d = *desc;
+        d.name = names[i];
+        ids[i] = pngd_CacheRegister(cache,&d);
+    }
+    Check(ids[0]>=0 && ids[1]>=0 && ids[2]>=0 && pngd_CacheFind(cache,"b")==ids[1] && pngd_CacheFind(cache,"d")==-1,"pngd_CacheRegister(...) and pngd_CacheFind(...)");
+    for (i=0;i<6;i++) {
+        const unsigned* pixels = (const unsigned*) pngd_CacheGetPixels(cache,ids[sequence[i]]);
+        if (!pixels || memcmp(pixels,reference,size)!=0) samePixels = 0;
+    }
+    Check(samePixels,"pngd_CacheGetPixels(...) gives the pngd_DecodeImage(...) pixels");
+    pngd_CacheGetStats(cache,&stats);
+    printf("cache: %lu hits, %lu misses, %lu evictions, %d/%d images resident\n",(unsigned long)stats.numHits,(unsigned long)stats.numMisses,(unsigned long)stats.numEvictions,stats.numImagesResident,stats.numImages);
+    Check(stats.numHits==2 && stats.numMisses==4 && stats.numEvictions==2,"cache hit, miss and eviction counts");
+    Check(stats.numImagesResident==2 && stats.bytesResident==2*size && stats.peakBytesResident==2*size,"cache resident bytes within the budget");
+    pngd_CacheSetBudget(cache,size);   // evicts the least recently used image (0)
+    pngd_CacheGetStats(cache,&stats);
+    Check(stats.numEvictions==3 && stats.numImagesResident==1 && pngd_CacheGetPixels(cache,ids[2])!=NULL,"pngd_CacheSetBudget(...) evicts down to the budget");
+    pngd_CacheGetStats(cache,&stats);
+    Check(stats.numHits==3 && stats.numMisses==4,"the most recently used image survives");
+    pngd_CacheDestroy(cache);
+}
+
+// pngd_DecodeImages(...): the even images go to caller buffers, the odd ones to the arena
+static void CheckBatch(const pngd_ImageDesc* desc,const unsigned* reference,const unsigned* invertedPalette,const unsigned* invertedReference) {
+    const size_t size = (size_t)desc->width*desc->height*sizeof(unsigned);
+    pngd_ImageDesc descs[NUM_BATCH_IMAGES];void* pixels[NUM_BATCH_IMAGES];
+    unsigned* buffers[NUM_BATCH_IMAGES];int numCallbacks[NUM_BATCH_IMAGES];
+    void* arena;int i,t,ok;char what[128];
+    for (i=0;i<NUM_BATCH_IMAGES;i++) {descs[i] = *desc;if (i&1) descs[i].palette = invertedPalette;}
+    arena = malloc(pngd_GetBatchArenaSize(descs,NUM_BATCH_IMAGES));
+    for (i=0;i<NUM_BATCH_IMAGES;i++) buffers[i] = (unsigned*) malloc(size);
+    for (t=1;t>=0;t--) {     // 1 thread, then 0 (one per core)
+        for (i=0;i<NUM_BATCH_IMAGES;i++) {
+            pixels[i] = (i&1) ? NULL : buffers[i];numCallbacks[i] = 0;
+            if (buffers[i]) memset(buffers[i],0,size);
+        }
+        if (arena) memset(arena,0,pngd_GetBatchArenaSize(descs,NUM_BATCH_IMAGES));
+        ok = arena && pngd_DecodeImages(descs,NUM_BATCH_IMAGES,pixels,arena,t,&OnImageDecoded,numCallbacks);
+        for (i=0;ok && i<NUM_BATCH_IMAGES;i++) {
+            ok = numCallbacks[i]==1 && pixels[i] && ((i&1) ? (pixels[i]!=buffers[i]) : (pixels[i]==buffers[i]));
+            if (ok) ok = memcmp(pixels[i],(i&1) ? invertedReference : reference,size)==0;
+        }
+        sprintf(what,"pngd_DecodeImages(...) with %s gives the pngd_DecodeImage(...) pixels",t==1 ? "1 thread" : "one thread per core");
+        Check(ok,what);
+    }
+    for (i=0;i<NUM_BATCH_IMAGES;i++) free(buffers[i]);
+    free(arena);
+}
+
+int main (int argc,char* argv[])
+{
+#   include INL_FILE
+
+    pngd_ImageDesc desc = PNGD_ZERO_INIT, invertedDesc;
+    unsigned* decoded;unsigned char* expected;unsigned* invertedPalette;unsigned* invertedDecoded;
+    int w,h,c,i,numMismatches=0;
+    if (argc<2) {printf("Usage: %s image.png (the image the .inl file was made from)\n",argv[0]);return 1;}
+    if (sizeof(palette[0])!=4) {printf("Error: the .inl file has an 8-bit palette.\n");return 1;}
+
+    desc.width = width;desc.height = height;desc.encoding = ENCODING;
+    desc.palette = palette;desc.numPalette = sizeof(palette)/sizeof(palette[0]);desc.bytesPerPixel = 4;
+    if (ENCODING==PNGD_ENCODING_CHARS || ENCODING==PNGD_ENCODING_CHARS_V2) desc.indices = *(const char**)(const void*)indices;   // (a single string)
+    else {desc.indices = indices;desc.numIndices = sizeof(indices)/sizeof(indices[0]);}
+#   ifdef SCANNED
+    desc.scanOrder = scanOrder;
+#   endif
+
+    expected = stbi_load(argv[1],&w,&h,&c,4);
+    if (!expected) {printf("Error: cannot load \"%s\".\n",argv[1]);return 1;}
+    if (w!=width || h!=height) {printf("Error: \"%s\" is %dx%d, but the .inl file is %dx%d.\n",argv[1],w,h,width,height);stbi_image_free(expected);return 1;}
+    decoded = (unsigned*) malloc((size_t)width*height*sizeof(unsigned));
+    invertedDecoded = (unsigned*) malloc((size_t)width*height*sizeof(unsigned));
+    invertedPalette = (unsigned*) malloc((size_t)desc.numPalette*sizeof(unsigned));
+    if (!decoded || !invertedDecoded || !invertedPalette) {printf("Error: out of memory.\n");stbi_image_free(expected);return 1;}
+
+    pngd_DecodeImage(decoded,&desc);
+    for (i=0;i<width*height;i++) {
+        const unsigned char* e = &expected[i*4];
+        const unsigned color = (unsigned)e[0]|((unsigned)e[1]<<8)|((unsigned)e[2]<<16)|((unsigned)e[3]<<24);   // (little-endian palette)
+        if (decoded[i]!=color) {
+            if (numMismatches++<8) printf("Mismatch at (%d,%d): %08X instead of %08X.\n",i%width,i/width,decoded[i],color);
+        }
+    }
+    printf("%s: %dx%d, %d colors\n",INL_FILE,width,height,desc.numPalette);
+    Check(numMismatches==0,"pngd_DecodeImage(...) gives the pixels of the image");
+
+    for (i=0;i<desc.numPalette;i++) invertedPalette[i] = ~((const unsigned*)desc.palette)[i];
+    invertedDesc = desc;invertedDesc.palette = invertedPalette;
+    pngd_DecodeImage(invertedDecoded,&invertedDesc);
+    CheckCache(&desc,decoded);
+    CheckBatch(&desc,decoded,invertedPalette,invertedDecoded);
+
+    free(invertedPalette);free(invertedDecoded);free(decoded);stbi_image_free(expected);
+return numFailures==0 ? 0 : 1;
+}
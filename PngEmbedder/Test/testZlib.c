@@ -0,0 +1,58 @@
+// https://github.com/Flix01/Flix-Tools
+//
+// Regression check of the inflate in ../stb_image.h on raw deflate streams (made with zlib, wbits=-15):
+// stored blocks that start in the last input bytes, e.g. a sync flush followed by a final empty stored block.
+//
+// TO COMPILE THIS ON LINUX:
+//
+// gcc -Os -no-pie testZlib.c -o testZlib -lm
+// ./testZlib
+//
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    const char* name;
+    const char* plain;int plainSize;
+    const unsigned char* stream;int streamSize;
+} RawStream;
+
+static const unsigned char syncFlushThenEmptyStored[] = {0xca,0x48,0xcd,0xc9,0xc9,0xd7,0x51,0xc8,0x40,0xa2,0x00,0x00,0x00,0x00,0xff,0xff,0x01,0x00,0x00,0xff,0xff};
+static const unsigned char storedOnly[] = {0x01,0x0c,0x00,0xf3,0xff,0x73,0x74,0x6f,0x72,0x65,0x64,0x20,0x62,0x79,0x74,0x65,0x73};
+static const unsigned char fullFlushThenFixed[] = {0x4a,0x4c,0x4a,0x4e,0x1c,0x7c,0x08,0x00,0x00,0x00,0xff,0xff,0xab,0xa8,0xac,0x02,0x00};
+static const unsigned char syncFlushThenFixed[] = {0x4a,0x04,0x00,0x00,0x00,0xff,0xff,0x03,0x00};
+
+int main (int argc,char* argv[])
+{
+    char abc[153+1];
+    RawStream streams[4];
+    int i,numFailed=0;
+    (void)argc;(void)argv;
+    for (i=0;i<150;i++) abc[i] = "abc"[i%3];
+    memcpy(&abc[150],"xyz",4);
+
+    streams[0].name = "sync flush + final empty stored block";streams[0].plain = "hello, hello, hello";streams[0].plainSize = 19;
+    streams[0].stream = syncFlushThenEmptyStored;streams[0].streamSize = (int)sizeof(syncFlushThenEmptyStored);
+    streams[1].name = "single stored block";streams[1].plain = "stored bytes";streams[1].plainSize = 12;
+    streams[1].stream = storedOnly;streams[1].streamSize = (int)sizeof(storedOnly);
+    streams[2].name = "full flush + fixed block";streams[2].plain = abc;streams[2].plainSize = 153;
+    streams[2].stream = fullFlushThenFixed;streams[2].streamSize = (int)sizeof(fullFlushThenFixed);
+    streams[3].name = "sync flush + final fixed block";streams[3].plain = "a";streams[3].plainSize = 1;
+    streams[3].stream = syncFlushThenFixed;streams[3].streamSize = (int)sizeof(syncFlushThenFixed);
+
+    for (i=0;i<4;i++) {
+        const RawStream* rs = &streams[i];
+        int outSize = -1,ok;
+        char* out = stbi_zlib_decode_noheader_malloc((const char*)rs->stream,rs->streamSize,&outSize);
+        ok = out && outSize==rs->plainSize && memcmp(out,rs->plain,(size_t)outSize)==0;
+        printf("%-40s %s\n",rs->name,ok ? "OK" : (out ? "FAILED (wrong output)" : "FAILED (not decoded)"));
+        if (!ok) ++numFailed;
+        if (out) STBI_FREE(out);
+    }
+
+return numFailed==0 ? 0 : 1;
+}
@@ -2,13 +2,16 @@
 //
 // TO COMPILE THIS ON LINUX:
 //
-// gcc -Os --std=gnu89 -no-pie pngEmbedder.c -o pngEmbedder -lm
+// gcc -Os --std=gnu89 -no-pie pngEmbedder.c -o pngEmbedder -lm -lpthread
+//
+// (add -DPNGEMBEDDER_NO_THREADS to build a single-threaded version without -lpthread)
 //
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <stdarg.h>
 #ifndef ASSERT
 #include <assert.h>
 #define ASSERT(X) assert(X)
@@ -17,6 +20,22 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#ifdef _WIN32
+#   include <windows.h>        // threads, QueryPerformanceCounter() and file mapping
+#   include <io.h>             // _setmode (binary stdin)
+#   include <fcntl.h>
+#else
+#   ifndef PNGEMBEDDER_NO_THREADS
+#       include <pthread.h>
+#   endif
+#   include <unistd.h>         // sysconf
+#   include <time.h>           // clock_gettime
+#   include <sys/resource.h>   // getrusage
+#   include <sys/mman.h>       // mmap
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#endif
+
 
 //#define INVERT_FLIPY_DEFAULT
 //#define NO_USAGE_IN_INL_FILES
@@ -71,6 +90,846 @@ static const char* decodeImageIntUsage[] = {"void DecodeImageInt(unsigned* pPixe
                                          "// DecodeImageInt(&raw[0],palette,sizeof(palette)/sizeof(palette[0]),indices,sizeof(indices)/sizeof(indices[0]));\n"
                                          };
 
+static const char* decodeImage8Usage[] = {"void DecodeImage8(unsigned char* pPixelsOut,const unsigned char* palette,const char* indices) {\n"
+                                         "    unsigned char* pRaw = pPixelsOut;unsigned char pal;\n"
+                                         "    const char* pc;char lastChar=(char)255,c,j,hasReps=0;\n"
+                                         "    for (pc=indices;*pc!='\\0';++pc)  {\n"
+                                         "        c = *pc;if (hasReps==0 && c=='~') {hasReps=1;continue;}\n"
+                                         "        c = c>='\\\\' ? (c-'1') : (c-'0');\n"
+                                         "        if (hasReps) {\n"
+                                         "            pal = palette[(unsigned char)lastChar];\n"
+                                         "            for (j=0;j<c;j++) *pRaw++ = pal;\n"
+                                         "            hasReps=0;continue;\n"
+                                         "        }\n"
+                                         "        *pRaw++ = palette[(unsigned char)c];lastChar = c;\n"
+                                         "    }\n"
+                                         "}\n\n"
+                                         "// unsigned char raw[width*height];  /* R8 or A8 texture (see the comment above 'palette') */\n"
+                                         "// DecodeImage8(&raw[0],palette,*indices);\n"
+};
+
+static const char* decodeImageInt8Usage[] = {"void DecodeImageInt8(unsigned char* pPixelsOut,const unsigned char* palette,const int* indices,const unsigned numIndices) {\n"
+                                         "    unsigned i;unsigned char pal,*pRaw = pPixelsOut;\n"
+                                         "    int lastIdx=-1,idx=-1,j,numReps=0;\n"
+                                         "    for (i=0;i<numIndices;i++)  {\n"
+                                         "        idx = indices[i];\n"
+                                         "        if (idx<0) {\n"
+                                         "            numReps=-idx;pal = palette[lastIdx];\n"
+                                         "            for (j=0;j<numReps;j++) *pRaw++ = pal;\n"
+                                         "        }\n"
+                                         "        else {*pRaw++ = palette[idx];lastIdx = idx;}\n"
+                                         "    }\n"
+                                         "}\n\n"
+                                         "// unsigned char raw[width*height];  /* R8 or A8 texture (see the comment above 'palette') */\n"
+                                         "// DecodeImageInt8(&raw[0],palette,indices,sizeof(indices)/sizeof(indices[0]));\n"
+                                         };
+
+// Big endian support of the RGBA decoders added after DecodeImage(...) and DecodeImageInt(...): they swap a local copy of the palette
+// (PALETTE_BE_SIZE is written before this text), so that 'palette' and 'paletteVariants' are never modified
+static const char* swapPaletteBEUsage[] = {"const unsigned* SwapPaletteBE(unsigned* paletteBE,const unsigned* palette) {\n"
+                                           "    int i;\n"
+                                           "    for (i=0;i<PALETTE_BE_SIZE;i++) paletteBE[i] = (palette[i]>>24)|((palette[i]>>8)&0xFF00U)|((palette[i]<<8)&0xFF0000U)|(palette[i]<<24);\n"
+                                           "    return paletteBE;\n"
+                                           "}\n"
+                                           "#endif\n"
+                                           "\n"
+                                           };
+
+static const char* decodeImage1bppUsage[] = {"void DecodeImage1bpp(unsigned* pPixelsOut,const unsigned* palette,const unsigned char* indices,int width,int height) {\n"
+                                             "    unsigned lut[16][4],*pRaw = pPixelsOut;const unsigned* l;\n"
+                                             "    const int numFullBytes = width/8, numLastBits = width%8;\n"
+                                             "    int x=0,y=0,k,numReps=0;unsigned char b=0;\n"
+                                             "#   ifdef USE_BIG_ENDIAN_MACHINE\n"
+                                             "    unsigned paletteBE[PALETTE_BE_SIZE];\n"
+                                             "    palette = SwapPaletteBE(paletteBE,palette);\n"
+                                             "#   endif\n"
+                                             "    for (k=0;k<64;k++) lut[k/4][k%4] = palette[(k/4>>(3-k%4))&1];  /* 8 pixels per byte with 2 lookups */\n"
+                                             "    while (y<height) {\n"
+                                             "        if (numReps>0) --numReps;\n"
+                                             "        else {b = *indices++;if (b==0x00 || b==0xFF) numReps = (int)(*indices++)-1;}\n"
+                                             "        if (x<numFullBytes) {\n"
+                                             "            l = lut[b>>4];  pRaw[0]=l[0];pRaw[1]=l[1];pRaw[2]=l[2];pRaw[3]=l[3];\n"
+                                             "            l = lut[b&15];  pRaw[4]=l[0];pRaw[5]=l[1];pRaw[6]=l[2];pRaw[7]=l[3];\n"
+                                             "            pRaw+=8;\n"
+                                             "            if (++x<numFullBytes || numLastBits>0) continue;\n"
+                                             "        }\n"
+                                             "        else for (k=0;k<numLastBits;k++) *pRaw++ = palette[(b>>(7-k))&1];\n"
+                                             "        x=0;++y;\n"
+                                             "    }\n"
+                                             "}\n"
+                                             "\n"
+                                             "// unsigned int raw[width*height];\n"
+                                             "// DecodeImage1bpp(&raw[0],palette,indices,width,height);\n"
+                                             };
+
+static const char* decodeImage1bpp8Usage[] = {"void DecodeImage1bpp8(unsigned char* pPixelsOut,const unsigned char* palette,const unsigned char* indices,int width,int height) {\n"
+                                              "    unsigned char lut[16][4],*pRaw = pPixelsOut;const unsigned char* l;\n"
+                                              "    const int numFullBytes = width/8, numLastBits = width%8;\n"
+                                              "    int x=0,y=0,k,numReps=0;unsigned char b=0;\n"
+                                              "    for (k=0;k<64;k++) lut[k/4][k%4] = palette[(k/4>>(3-k%4))&1];  /* 8 pixels per byte with 2 lookups */\n"
+                                              "    while (y<height) {\n"
+                                              "        if (numReps>0) --numReps;\n"
+                                              "        else {b = *indices++;if (b==0x00 || b==0xFF) numReps = (int)(*indices++)-1;}\n"
+                                              "        if (x<numFullBytes) {\n"
+                                              "            l = lut[b>>4];  pRaw[0]=l[0];pRaw[1]=l[1];pRaw[2]=l[2];pRaw[3]=l[3];\n"
+                                              "            l = lut[b&15];  pRaw[4]=l[0];pRaw[5]=l[1];pRaw[6]=l[2];pRaw[7]=l[3];\n"
+                                              "            pRaw+=8;\n"
+                                              "            if (++x<numFullBytes || numLastBits>0) continue;\n"
+                                              "        }\n"
+                                              "        else for (k=0;k<numLastBits;k++) *pRaw++ = palette[(b>>(7-k))&1];\n"
+                                              "        x=0;++y;\n"
+                                              "    }\n"
+                                              "}\n"
+                                              "\n"
+                                              "// unsigned char raw[width*height];  /* R8 or A8 texture (see the comment above 'palette') */\n"
+                                              "// DecodeImage1bpp8(&raw[0],palette,indices,width,height);\n"
+                                              };
+static const char* decodeImageV2Usage[] = {"void DecodeImageV2(unsigned* pPixelsOut,const unsigned* palette,const char* indices) {\n"
+                                           "    /* symbol value: '!'..'~' without '\"', ':', '?' and '\\\\' */\n"
+                                           "#   define DECODE_V2_SYMBOL(C) ((unsigned)(C)-33U-((C)>'\"')-((C)>':')-((C)>'?')-((C)>'\\\\'))\n"
+                                           "    const unsigned char* pc = (const unsigned char*) indices;\n"
+                                           "    unsigned *pRaw = pPixelsOut,pal=0,v,numDirect,numReps,mul;\n"
+                                           "#   ifdef USE_BIG_ENDIAN_MACHINE\n"
+                                           "    unsigned paletteBE[PALETTE_BE_SIZE];\n"
+                                           "    palette = SwapPaletteBE(paletteBE,palette);\n"
+                                           "#   endif\n"
+                                           "    if (*pc!='2') return;   /* version */\n"
+                                           "    numDirect = DECODE_V2_SYMBOL(pc[1]);pc+=2;\n"
+                                           "    while (*pc)  {\n"
+                                           "        v = DECODE_V2_SYMBOL(*pc);++pc;\n"
+                                           "        if (v<numDirect) pal = palette[v];\n"
+                                           "        else if (v<89) {pal = palette[numDirect+(v-numDirect)*90+DECODE_V2_SYMBOL(*pc)];++pc;}\n"
+                                           "        else {\n"
+                                           "            numReps=1;mul=1;\n"
+                                           "            do {v = DECODE_V2_SYMBOL(*pc);++pc;numReps+=(v>=45?v-45:v)*mul;mul*=45;} while (v>=45);\n"
+                                           "            while (numReps--) *pRaw++ = pal;\n"
+                                           "            continue;\n"
+                                           "        }\n"
+                                           "        *pRaw++ = pal;\n"
+                                           "    }\n"
+                                           "#   undef DECODE_V2_SYMBOL\n"
+                                           "}\n"
+                                           "\n"
+                                           "// unsigned int raw[width*height];\n"
+                                           "// DecodeImageV2(&raw[0],palette,*indices);\n"
+                                           };
+
+static const char* decodeImageV2_8Usage[] = {"void DecodeImageV2_8(unsigned char* pPixelsOut,const unsigned char* palette,const char* indices) {\n"
+                                             "    /* symbol value: '!'..'~' without '\"', ':', '?' and '\\\\' */\n"
+                                             "#   define DECODE_V2_SYMBOL(C) ((unsigned)(C)-33U-((C)>'\"')-((C)>':')-((C)>'?')-((C)>'\\\\'))\n"
+                                             "    const unsigned char* pc = (const unsigned char*) indices;\n"
+                                             "    unsigned char *pRaw = pPixelsOut,pal=0;unsigned v,numDirect,numReps,mul;\n"
+                                             "    if (*pc!='2') return;   /* version */\n"
+                                             "    numDirect = DECODE_V2_SYMBOL(pc[1]);pc+=2;\n"
+                                             "    while (*pc)  {\n"
+                                             "        v = DECODE_V2_SYMBOL(*pc);++pc;\n"
+                                             "        if (v<numDirect) pal = palette[v];\n"
+                                             "        else if (v<89) {pal = palette[numDirect+(v-numDirect)*90+DECODE_V2_SYMBOL(*pc)];++pc;}\n"
+                                             "        else {\n"
+                                             "            numReps=1;mul=1;\n"
+                                             "            do {v = DECODE_V2_SYMBOL(*pc);++pc;numReps+=(v>=45?v-45:v)*mul;mul*=45;} while (v>=45);\n"
+                                             "            while (numReps--) *pRaw++ = pal;\n"
+                                             "            continue;\n"
+                                             "        }\n"
+                                             "        *pRaw++ = pal;\n"
+                                             "    }\n"
+                                             "#   undef DECODE_V2_SYMBOL\n"
+                                             "}\n"
+                                             "\n"
+                                             "// unsigned char raw[width*height];  /* R8 or A8 texture (see the comment above 'palette') */\n"
+                                             "// DecodeImageV2_8(&raw[0],palette,*indices);\n"
+                                             };
+
+static const char* decodeImageIntNarrowUsage[] = {"void DecodeImageInt$N(unsigned* pPixelsOut,const unsigned* palette,const unsigned numPalette,const $T* indices,const unsigned numIndices) {\n"
+                                                  "    unsigned pal=0,i,j,numReps,*pRaw = pPixelsOut;\n"
+                                                  "#   ifdef USE_BIG_ENDIAN_MACHINE\n"
+                                                  "    unsigned paletteBE[PALETTE_BE_SIZE];\n"
+                                                  "    palette = SwapPaletteBE(paletteBE,palette);\n"
+                                                  "#   endif\n"
+                                                  "    for (i=0;i<numIndices;i++)  {\n"
+                                                  "        if (indices[i]!=numPalette) {*pRaw++ = pal = palette[indices[i]];continue;}\n"
+                                                  "        numReps = (unsigned)indices[++i];   /* 'numPalette' is followed by the number of further repetitions */\n"
+                                                  "        for (j=0;j<numReps;j++) *pRaw++ = pal;\n"
+                                                  "    }\n"
+                                                  "}\n"
+                                                  "\n"
+                                                  "// unsigned int raw[width*height];\n"
+                                                  "// DecodeImageInt$N(&raw[0],palette,sizeof(palette)/sizeof(palette[0]),indices,sizeof(indices)/sizeof(indices[0]));\n"
+                                                  };
+
+static const char* decodeImageIntNarrow8Usage[] = {"void DecodeImageInt$N_8(unsigned char* pPixelsOut,const unsigned char* palette,const unsigned numPalette,const $T* indices,const unsigned numIndices) {\n"
+                                                   "    unsigned i,j,numReps;unsigned char pal=0,*pRaw = pPixelsOut;\n"
+                                                   "    for (i=0;i<numIndices;i++)  {\n"
+                                                   "        if (indices[i]!=numPalette) {*pRaw++ = pal = palette[indices[i]];continue;}\n"
+                                                   "        numReps = (unsigned)indices[++i];   /* 'numPalette' is followed by the number of further repetitions */\n"
+                                                   "        for (j=0;j<numReps;j++) *pRaw++ = pal;\n"
+                                                   "    }\n"
+                                                   "}\n"
+                                                   "\n"
+                                                   "// unsigned char raw[width*height];  /* R8 or A8 texture (see the comment above 'palette') */\n"
+                                                   "// DecodeImageInt$N_8(&raw[0],palette,sizeof(palette)/sizeof(palette[0]),indices,sizeof(indices)/sizeof(indices[0]));\n"
+                                                   };
+
+// Progressive decoders (--progressive): the narrow int mode ($T and $N) on indices stored in Adam7 pass order
+static const char* decodeImageProgressiveUsage[] = {"/* Progressive decoding: every call decodes the next of the 7 passes (like PNG's Adam7 interlacing) and fills the blocks they cover,\n"
+                                                    "   so that 'pPixelsOut' is a usable (blocky) version of the image after each call. It returns the number of passes left. */\n"
+                                                    "typedef struct {unsigned pos,numReps,idx,pass;} DecodeProgressiveState;  /* zero-initialize it before the first call */\n"
+                                                    "int DecodeImageProgressive$N(unsigned* pPixelsOut,const unsigned* palette,const unsigned numPalette,const $T* indices,int width,int height,DecodeProgressiveState* s) {\n"
+                                                    "    static const unsigned char passes[7][6] = {{0,0,8,8,8,8},{4,0,8,8,4,8},{0,4,4,8,4,4},{2,0,4,4,2,4},{0,2,2,4,2,2},{1,0,2,2,1,2},{0,1,1,2,1,1}};  /* x0,y0,dx,dy,block width,block height */\n"
+                                                    "    const unsigned char* p;unsigned pal,*pRaw;int x,y,bx,by;\n"
+                                                    "#   ifdef USE_BIG_ENDIAN_MACHINE\n"
+                                                    "    unsigned paletteBE[PALETTE_BE_SIZE];\n"
+                                                    "    palette = SwapPaletteBE(paletteBE,palette);\n"
+                                                    "#   endif\n"
+                                                    "    if (s->pass>=7) return 0;\n"
+                                                    "    p = passes[s->pass++];\n"
+                                                    "    for (y=p[1];y<height;y+=p[3]) {\n"
+                                                    "        for (x=p[0];x<width;x+=p[2]) {\n"
+                                                    "            if (s->numReps>0) --s->numReps;\n"
+                                                    "            else if (indices[s->pos]!=numPalette) s->idx = (unsigned)indices[s->pos++];\n"
+                                                    "            else {s->numReps = (unsigned)indices[s->pos+1]-1;s->pos+=2;}   /* 'numPalette' is followed by the number of further repetitions */\n"
+                                                    "            pal = palette[s->idx];\n"
+                                                    "            for (by=y;by<y+p[5] && by<height;by++) {\n"
+                                                    "                pRaw = &pPixelsOut[by*width];\n"
+                                                    "                for (bx=x;bx<x+p[4] && bx<width;bx++) pRaw[bx] = pal;\n"
+                                                    "            }\n"
+                                                    "        }\n"
+                                                    "    }\n"
+                                                    "    return 7-(int)s->pass;\n"
+                                                    "}\n"
+                                                    "\n"
+                                                    "// unsigned int raw[width*height];DecodeProgressiveState state = {0,0,0,0};\n"
+                                                    "// while (DecodeImageProgressive$N(&raw[0],palette,sizeof(palette)/sizeof(palette[0]),indices,width,height,&state)) {/* 'raw' can already be shown */}\n"
+                                                    };
+
+static const char* decodeImageProgressive8Usage[] = {"/* Progressive decoding: every call decodes the next of the 7 passes (like PNG's Adam7 interlacing) and fills the blocks they cover,\n"
+                                                     "   so that 'pPixelsOut' is a usable (blocky) version of the image after each call. It returns the number of passes left. */\n"
+                                                     "typedef struct {unsigned pos,numReps,idx,pass;} DecodeProgressiveState;  /* zero-initialize it before the first call */\n"
+                                                     "int DecodeImageProgressive$N_8(unsigned char* pPixelsOut,const unsigned char* palette,const unsigned numPalette,const $T* indices,int width,int height,DecodeProgressiveState* s) {\n"
+                                                     "    static const unsigned char passes[7][6] = {{0,0,8,8,8,8},{4,0,8,8,4,8},{0,4,4,8,4,4},{2,0,4,4,2,4},{0,2,2,4,2,2},{1,0,2,2,1,2},{0,1,1,2,1,1}};  /* x0,y0,dx,dy,block width,block height */\n"
+                                                     "    const unsigned char* p;unsigned char pal,*pRaw;int x,y,bx,by;\n"
+                                                     "    if (s->pass>=7) return 0;\n"
+                                                     "    p = passes[s->pass++];\n"
+                                                     "    for (y=p[1];y<height;y+=p[3]) {\n"
+                                                     "        for (x=p[0];x<width;x+=p[2]) {\n"
+                                                     "            if (s->numReps>0) --s->numReps;\n"
+                                                     "            else if (indices[s->pos]!=numPalette) s->idx = (unsigned)indices[s->pos++];\n"
+                                                     "            else {s->numReps = (unsigned)indices[s->pos+1]-1;s->pos+=2;}   /* 'numPalette' is followed by the number of further repetitions */\n"
+                                                     "            pal = palette[s->idx];\n"
+                                                     "            for (by=y;by<y+p[5] && by<height;by++) {\n"
+                                                     "                pRaw = &pPixelsOut[by*width];\n"
+                                                     "                for (bx=x;bx<x+p[4] && bx<width;bx++) pRaw[bx] = pal;\n"
+                                                     "            }\n"
+                                                     "        }\n"
+                                                     "    }\n"
+                                                     "    return 7-(int)s->pass;\n"
+                                                     "}\n"
+                                                     "\n"
+                                                     "// unsigned char raw[width*height];DecodeProgressiveState state = {0,0,0,0};  /* R8 or A8 texture (see the comment above 'palette') */\n"
+                                                     "// while (DecodeImageProgressive$N_8(&raw[0],palette,sizeof(palette)/sizeof(palette[0]),indices,width,height,&state)) {/* 'raw' can already be shown */}\n"
+                                                     };
+
+// Quadtree decoders (--quadtree): $T and $N are the value type (unsigned char or unsigned short) and its suffix
+static const char* decodeImageQuadtreeUsage[] = {"/* Quadtree decoding: the image is split into 64x64 blocks (in row-major order), and every block is a tree of square nodes.\n"
+                                                 "   A value smaller than numPalette fills its node (clipped to the image) with that palette index, while numPalette splits the node\n"
+                                                 "   into 4 children (top-left, top-right, bottom-left, bottom-right). The children completely outside the image are not stored. */\n"
+                                                 "const $T* DecodeQuadtreeNode$N(unsigned* pPixelsOut,int width,int height,int x,int y,int size,const unsigned* palette,const unsigned numPalette,const $T* indices) {\n"
+                                                 "    if (*indices==numPalette) {\n"
+                                                 "        const int half = size/2;\n"
+                                                 "        indices = DecodeQuadtreeNode$N(pPixelsOut,width,height,x,y,half,palette,numPalette,indices+1);\n"
+                                                 "        if (x+half<width) indices = DecodeQuadtreeNode$N(pPixelsOut,width,height,x+half,y,half,palette,numPalette,indices);\n"
+                                                 "        if (y+half<height) {\n"
+                                                 "            indices = DecodeQuadtreeNode$N(pPixelsOut,width,height,x,y+half,half,palette,numPalette,indices);\n"
+                                                 "            if (x+half<width) indices = DecodeQuadtreeNode$N(pPixelsOut,width,height,x+half,y+half,half,palette,numPalette,indices);\n"
+                                                 "        }\n"
+                                                 "    }\n"
+                                                 "    else {\n"
+                                                 "        const unsigned value = palette[*indices];\n"
+                                                 "        const int w = x+size<width ? size : width-x, h = y+size<height ? size : height-y;\n"
+                                                 "        unsigned* pRaw = &pPixelsOut[y*width+x];int i,j;\n"
+                                                 "        for (j=0;j<h;j++,pRaw+=width) {for (i=0;i<w;i++) pRaw[i] = value;}   /* (the inner loop becomes wide stores) */\n"
+                                                 "        ++indices;\n"
+                                                 "    }\n"
+                                                 "    return indices;\n"
+                                                 "}\n"
+                                                 "void DecodeImageQuadtree$N(unsigned* pPixelsOut,const unsigned* palette,const unsigned numPalette,const $T* indices,int width,int height) {\n"
+                                                 "    int x,y;\n"
+                                                 "#   ifdef USE_BIG_ENDIAN_MACHINE\n"
+                                                 "    unsigned paletteBE[PALETTE_BE_SIZE];\n"
+                                                 "    palette = SwapPaletteBE(paletteBE,palette);   /* (the nodes use the swapped copy) */\n"
+                                                 "#   endif\n"
+                                                 "    for (y=0;y<height;y+=64) {\n"
+                                                 "        for (x=0;x<width;x+=64) indices = DecodeQuadtreeNode$N(pPixelsOut,width,height,x,y,64,palette,numPalette,indices);\n"
+                                                 "    }\n"
+                                                 "}\n"
+                                                 "\n"
+                                                 "// unsigned int raw[width*height];\n"
+                                                 "// DecodeImageQuadtree$N(&raw[0],palette,sizeof(palette)/sizeof(palette[0]),indices,width,height);\n"
+                                                };
+
+static const char* decodeImageQuadtree8Usage[] = {"/* Quadtree decoding: the image is split into 64x64 blocks (in row-major order), and every block is a tree of square nodes.\n"
+                                                  "   A value smaller than numPalette fills its node (clipped to the image) with that palette index, while numPalette splits the node\n"
+                                                  "   into 4 children (top-left, top-right, bottom-left, bottom-right). The children completely outside the image are not stored. */\n"
+                                                  "const $T* DecodeQuadtreeNode$N_8(unsigned char* pPixelsOut,int width,int height,int x,int y,int size,const unsigned char* palette,const unsigned numPalette,const $T* indices) {\n"
+                                                  "    if (*indices==numPalette) {\n"
+                                                  "        const int half = size/2;\n"
+                                                  "        indices = DecodeQuadtreeNode$N_8(pPixelsOut,width,height,x,y,half,palette,numPalette,indices+1);\n"
+                                                  "        if (x+half<width) indices = DecodeQuadtreeNode$N_8(pPixelsOut,width,height,x+half,y,half,palette,numPalette,indices);\n"
+                                                  "        if (y+half<height) {\n"
+                                                  "            indices = DecodeQuadtreeNode$N_8(pPixelsOut,width,height,x,y+half,half,palette,numPalette,indices);\n"
+                                                  "            if (x+half<width) indices = DecodeQuadtreeNode$N_8(pPixelsOut,width,height,x+half,y+half,half,palette,numPalette,indices);\n"
+                                                  "        }\n"
+                                                  "    }\n"
+                                                  "    else {\n"
+                                                  "        const unsigned char value = palette[*indices];\n"
+                                                  "        const int w = x+size<width ? size : width-x, h = y+size<height ? size : height-y;\n"
+                                                  "        unsigned char* pRaw = &pPixelsOut[y*width+x];int i,j;\n"
+                                                  "        for (j=0;j<h;j++,pRaw+=width) {for (i=0;i<w;i++) pRaw[i] = value;}   /* (the inner loop becomes wide stores) */\n"
+                                                  "        ++indices;\n"
+                                                  "    }\n"
+                                                  "    return indices;\n"
+                                                  "}\n"
+                                                  "void DecodeImageQuadtree$N_8(unsigned char* pPixelsOut,const unsigned char* palette,const unsigned numPalette,const $T* indices,int width,int height) {\n"
+                                                  "    int x,y;\n"
+                                                  "    for (y=0;y<height;y+=64) {\n"
+                                                  "        for (x=0;x<width;x+=64) indices = DecodeQuadtreeNode$N_8(pPixelsOut,width,height,x,y,64,palette,numPalette,indices);\n"
+                                                  "    }\n"
+                                                  "}\n"
+                                                  "\n"
+                                                  "// unsigned char raw[width*height];  /* R8 or A8 texture (see the comment above 'palette') */\n"
+                                                  "// DecodeImageQuadtree$N_8(&raw[0],palette,sizeof(palette)/sizeof(palette[0]),indices,width,height);\n"
+                                                 };
+
+// Span-list sprites (--spans): $T and $N are the value type and its suffix
+static const char* blitSpriteUsage[] = {"/* Sprite blitting: every row is a list of spans of non-transparent pixels (the number of spans, then the x, the length and the\n"
+                                        "   palette indices of each span). BlitSprite(...) copies only these pixels to 'dst' (32-bit pixels, with 'stride' bytes per row),\n"
+                                        "   so the time depends on the visible pixels only. The sprite goes at (x,y) and must fit in 'dst' (there is no clipping) */\n"
+                                        "void BlitSprite$N(unsigned* dst,int stride,int x,int y,const unsigned* palette,const $T* spans,int height) {\n"
+                                        "    int row,numSpans,i,len;\n"
+                                        "#   ifdef USE_BIG_ENDIAN_MACHINE\n"
+                                        "    unsigned paletteBE[PALETTE_BE_SIZE];\n"
+                                        "    palette = SwapPaletteBE(paletteBE,palette);\n"
+                                        "#   endif\n"
+                                        "    for (row=0;row<height;row++) {\n"
+                                        "        unsigned* pRow = (unsigned*)((unsigned char*)dst+(y+row)*stride)+x;\n"
+                                        "        for (numSpans=(int)*spans++;numSpans>0;--numSpans) {\n"
+                                        "            unsigned* p = pRow+*spans++;\n"
+                                        "            len = (int)*spans++;\n"
+                                        "            for (i=0;i<len;i++) p[i] = palette[spans[i]];\n"
+                                        "            spans+=len;\n"
+                                        "        }\n"
+                                        "    }\n"
+                                        "}\n"
+                                        "\n"
+                                        "// BlitSprite$N(&framebuffer[0],framebufferWidth*sizeof(unsigned),spriteX,spriteY,palette,indices,height);\n"
+                                       };
+
+static const char* blitSprite8Usage[] = {"/* Sprite blitting: every row is a list of spans of non-transparent pixels (the number of spans, then the x, the length and the\n"
+                                         "   palette indices of each span). BlitSprite(...) copies only these pixels to 'dst' (8-bit pixels, with 'stride' bytes per row),\n"
+                                         "   so the time depends on the visible pixels only. The sprite goes at (x,y) and must fit in 'dst' (there is no clipping) */\n"
+                                         "void BlitSprite$N_8(unsigned char* dst,int stride,int x,int y,const unsigned char* palette,const $T* spans,int height) {\n"
+                                         "    int row,numSpans,i,len;\n"
+                                         "    for (row=0;row<height;row++) {\n"
+                                         "        unsigned char* pRow = (unsigned char*)((unsigned char*)dst+(y+row)*stride)+x;\n"
+                                         "        for (numSpans=(int)*spans++;numSpans>0;--numSpans) {\n"
+                                         "            unsigned char* p = pRow+*spans++;\n"
+                                         "            len = (int)*spans++;\n"
+                                         "            for (i=0;i<len;i++) p[i] = palette[spans[i]];\n"
+                                         "            spans+=len;\n"
+                                         "        }\n"
+                                         "    }\n"
+                                         "}\n"
+                                         "\n"
+                                         "// BlitSprite$N_8(&target[0],targetWidth,spriteX,spriteY,palette,indices,height);  /* R8 or A8 target (see the comment above 'palette') */\n"
+                                        };
+
+// Decoders into a clip rectangle of a larger image (--rect-output): $P and $S are the pixel type and its suffix ("", "8" or "16")
+static const char* decodeRectUsage[] = {"/* Decoding into a rectangle of a larger image (e.g. a framebuffer or a texture atlas), without temporary buffers: only the pixels inside\n"
+                                        "   the clip rectangle (clipX,clipY,clipWidth,clipHeight in image coordinates, or 0,0,width,height for the whole image) are written to 'dst'\n"
+                                        "   (where pixel (clipX,clipY) goes), with 'stride' bytes per row. With palette==NULL the palette indices are written instead of the colors. */\n"
+                                        "typedef struct {$P* row;int stride,width,x,y,clipX0,clipY0,clipX1,clipY1;} DecodeRect$S;\n"
+                                        "void DecodeRectInit$S(DecodeRect$S* r,$P* dst,int stride,int width,int clipX,int clipY,int clipWidth,int clipHeight) {\n"
+                                        "    r->row=dst;r->stride=stride;r->width=width;r->x=0;r->y=0;\n"
+                                        "    r->clipX0=clipX;r->clipY0=clipY;r->clipX1=clipX+clipWidth;r->clipY1=clipY+clipHeight;\n"
+                                        "}\n"
+                                        "/* Writes 'count' pixels with the same value (in row-major order) */\n"
+                                        "void DecodeRectFill$S(DecodeRect$S* r,$P value,int count) {\n"
+                                        "    int n,x0,x1,i;\n"
+                                        "    while (count>0) {\n"
+                                        "        n = r->width-r->x<count ? r->width-r->x : count;\n"
+                                        "        if (r->y>=r->clipY0 && r->y<r->clipY1) {\n"
+                                        "            x0 = r->x>r->clipX0 ? r->x : r->clipX0;x1 = r->x+n<r->clipX1 ? r->x+n : r->clipX1;\n"
+                                        "            for (i=x0;i<x1;i++) r->row[i-r->clipX0] = value;\n"
+                                        "        }\n"
+                                        "        r->x+=n;count-=n;\n"
+                                        "        if (r->x==r->width) {\n"
+                                        "            if (r->y>=r->clipY0 && r->y<r->clipY1) r->row = ($P*)((unsigned char*)r->row+r->stride);\n"
+                                        "            r->x=0;++r->y;\n"
+                                        "        }\n"
+                                        "    }\n"
+                                        "}\n"
+                                       };
+
+static const char* decodeImageRectUsage[] = {"void DecodeImageRect$S($P* dst,int stride,int clipX,int clipY,int clipWidth,int clipHeight,const $P* palette,const char* indices,int width) {\n"
+                                             "    DecodeRect$S r;const char* pc;unsigned v,idx=0;int hasReps=0;\n$E"
+                                             "    DecodeRectInit$S(&r,dst,stride,width,clipX,clipY,clipWidth,clipHeight);\n"
+                                             "    for (pc=indices;*pc!='\\0' && r.y<r.clipY1;++pc) {\n"
+                                             "        if (hasReps==0 && *pc=='~') {hasReps=1;continue;}\n"
+                                             "        v = (unsigned)(*pc>='\\\\' ? *pc-'1' : *pc-'0');\n"
+                                             "        if (hasReps) {DecodeRectFill$S(&r,palette ? palette[idx] : ($P)idx,(int)v);hasReps=0;}\n"
+                                             "        else {idx=v;DecodeRectFill$S(&r,palette ? palette[idx] : ($P)idx,1);}\n"
+                                             "    }\n"
+                                             "}\n"
+                                             "\n"
+                                             "// DecodeImageRect$S(&target[targetY*targetWidth+targetX],targetWidth*sizeof($P),clipX,clipY,clipWidth,clipHeight,$L,*indices,width);\n"
+                                            };
+
+static const char* decodeImageIntRectUsage[] = {"void DecodeImageIntRect$S($P* dst,int stride,int clipX,int clipY,int clipWidth,int clipHeight,const $P* palette,const int* indices,const unsigned numIndices,int width) {\n"
+                                                "    DecodeRect$S r;unsigned i,idx=0;\n$E"
+                                                "    DecodeRectInit$S(&r,dst,stride,width,clipX,clipY,clipWidth,clipHeight);\n"
+                                                "    for (i=0;i<numIndices && r.y<r.clipY1;i++) {\n"
+                                                "        if (indices[i]<0) DecodeRectFill$S(&r,palette ? palette[idx] : ($P)idx,-indices[i]);\n"
+                                                "        else {idx=(unsigned)indices[i];DecodeRectFill$S(&r,palette ? palette[idx] : ($P)idx,1);}\n"
+                                                "    }\n"
+                                                "}\n"
+                                                "\n"
+                                                "// DecodeImageIntRect$S(&target[targetY*targetWidth+targetX],targetWidth*sizeof($P),clipX,clipY,clipWidth,clipHeight,$L,indices,sizeof(indices)/sizeof(indices[0]),width);\n"
+                                               };
+
+static const char* decodeImage1bppRectUsage[] = {"void DecodeImage1bppRect$S($P* dst,int stride,int clipX,int clipY,int clipWidth,int clipHeight,const $P* palette,const unsigned char* indices,int width,int height) {\n"
+                                                 "    DecodeRect$S r;const int numBytesPerRow = (width+7)/8;\n"
+                                                 "    int x,y,k,bit,lastBit=0,n=0,numReps=0;unsigned char b=0;\n$E"
+                                                 "    DecodeRectInit$S(&r,dst,stride,width,clipX,clipY,clipWidth,clipHeight);\n"
+                                                 "    for (y=0;y<height && y<r.clipY1;y++) {\n"
+                                                 "        for (x=0;x<numBytesPerRow;x++) {\n"
+                                                 "            if (numReps>0) --numReps;\n"
+                                                 "            else {b = *indices++;if (b==0x00 || b==0xFF) numReps = (int)(*indices++)-1;}\n"
+                                                 "            for (k=0;k<8 && x*8+k<width;k++) {\n"
+                                                 "                bit = (b>>(7-k))&1;\n"
+                                                 "                if (bit!=lastBit && n>0) {DecodeRectFill$S(&r,palette ? palette[lastBit] : ($P)lastBit,n);n=0;}\n"
+                                                 "                lastBit=bit;++n;\n"
+                                                 "            }\n"
+                                                 "        }\n"
+                                                 "    }\n"
+                                                 "    if (n>0) DecodeRectFill$S(&r,palette ? palette[lastBit] : ($P)lastBit,n);\n"
+                                                 "}\n"
+                                                 "\n"
+                                                 "// DecodeImage1bppRect$S(&target[targetY*targetWidth+targetX],targetWidth*sizeof($P),clipX,clipY,clipWidth,clipHeight,$L,indices,width,height);\n"
+                                                };
+
+static const char* decodeImageV2RectUsage[] = {"void DecodeImageV2Rect$S($P* dst,int stride,int clipX,int clipY,int clipWidth,int clipHeight,const $P* palette,const char* indices,int width) {\n"
+                                               "    /* symbol value: '!'..'~' without '\"', ':', '?' and '\\\\' */\n"
+                                               "#   define DECODE_V2_SYMBOL(C) ((unsigned)(C)-33U-((C)>'\"')-((C)>':')-((C)>'?')-((C)>'\\\\'))\n"
+                                               "    const unsigned char* pc = (const unsigned char*) indices;\n"
+                                               "    DecodeRect$S r;unsigned idx=0,v,numDirect,numReps,mul;\n$E"
+                                               "    if (*pc!='2') return;   /* version */\n"
+                                               "    DecodeRectInit$S(&r,dst,stride,width,clipX,clipY,clipWidth,clipHeight);\n"
+                                               "    numDirect = DECODE_V2_SYMBOL(pc[1]);pc+=2;\n"
+                                               "    while (*pc && r.y<r.clipY1)  {\n"
+                                               "        v = DECODE_V2_SYMBOL(*pc);++pc;\n"
+                                               "        if (v<numDirect) idx = v;\n"
+                                               "        else if (v<89) {idx = numDirect+(v-numDirect)*90+DECODE_V2_SYMBOL(*pc);++pc;}\n"
+                                               "        else {\n"
+                                               "            numReps=1;mul=1;\n"
+                                               "            do {v = DECODE_V2_SYMBOL(*pc);++pc;numReps+=(v>=45?v-45:v)*mul;mul*=45;} while (v>=45);\n"
+                                               "            DecodeRectFill$S(&r,palette ? palette[idx] : ($P)idx,(int)numReps);\n"
+                                               "            continue;\n"
+                                               "        }\n"
+                                               "        DecodeRectFill$S(&r,palette ? palette[idx] : ($P)idx,1);\n"
+                                               "    }\n"
+                                               "#   undef DECODE_V2_SYMBOL\n"
+                                               "}\n"
+                                               "\n"
+                                               "// DecodeImageV2Rect$S(&target[targetY*targetWidth+targetX],targetWidth*sizeof($P),clipX,clipY,clipWidth,clipHeight,$L,*indices,width);\n"
+                                              };
+
+static const char* decodeImageIntNarrowRectUsage[] = {"void DecodeImageInt$NRect$S($P* dst,int stride,int clipX,int clipY,int clipWidth,int clipHeight,const $P* palette,const unsigned numPalette,const $T* indices,const unsigned numIndices,int width) {\n"
+                                                      "    DecodeRect$S r;unsigned i,idx=0;\n$E"
+                                                      "    DecodeRectInit$S(&r,dst,stride,width,clipX,clipY,clipWidth,clipHeight);\n"
+                                                      "    for (i=0;i<numIndices && r.y<r.clipY1;i++) {\n"
+                                                      "        if (indices[i]!=numPalette) {idx=(unsigned)indices[i];DecodeRectFill$S(&r,palette ? palette[idx] : ($P)idx,1);}\n"
+                                                      "        else DecodeRectFill$S(&r,palette ? palette[idx] : ($P)idx,(int)indices[++i]);   /* 'numPalette' is followed by the number of further repetitions */\n"
+                                                      "    }\n"
+                                                      "}\n"
+                                                      "\n"
+                                                      "// DecodeImageInt$NRect$S(&target[targetY*targetWidth+targetX],targetWidth*sizeof($P),clipX,clipY,clipWidth,clipHeight,$L,sizeof(palette)/sizeof(palette[0]),indices,sizeof(indices)/sizeof(indices[0]),width);\n"
+                                                     };
+
+static const char* decodeImageQuadtreeRectUsage[] = {"const $T* DecodeQuadtreeNode$NRect$S(DecodeRect$S* r,int height,int x,int y,int size,const $P* palette,const unsigned numPalette,const $T* indices) {\n"
+                                                     "    if (*indices==numPalette) {\n"
+                                                     "        const int half = size/2;\n"
+                                                     "        indices = DecodeQuadtreeNode$NRect$S(r,height,x,y,half,palette,numPalette,indices+1);\n"
+                                                     "        if (x+half<r->width) indices = DecodeQuadtreeNode$NRect$S(r,height,x+half,y,half,palette,numPalette,indices);\n"
+                                                     "        if (y+half<height) {\n"
+                                                     "            indices = DecodeQuadtreeNode$NRect$S(r,height,x,y+half,half,palette,numPalette,indices);\n"
+                                                     "            if (x+half<r->width) indices = DecodeQuadtreeNode$NRect$S(r,height,x+half,y+half,half,palette,numPalette,indices);\n"
+                                                     "        }\n"
+                                                     "    }\n"
+                                                     "    else {\n"
+                                                     "        const $P value = palette ? palette[*indices] : ($P)*indices;\n"
+                                                     "        const int x0 = x>r->clipX0 ? x : r->clipX0, x1 = x+size<r->clipX1 ? x+size : r->clipX1;\n"
+                                                     "        const int y0 = y>r->clipY0 ? y : r->clipY0, y1 = y+size<r->clipY1 ? y+size : r->clipY1;\n"
+                                                     "        int i,j;\n"
+                                                     "        if (x0<x1 && y0<y1) {   /* the part of the node inside the clip rectangle */\n"
+                                                     "            $P* pRaw = ($P*)((unsigned char*)r->row+(y0-r->clipY0)*r->stride)+(x0-r->clipX0);\n"
+                                                     "            for (j=y0;j<y1;j++,pRaw=($P*)((unsigned char*)pRaw+r->stride)) {for (i=0;i<x1-x0;i++) pRaw[i] = value;}\n"
+                                                     "        }\n"
+                                                     "        ++indices;\n"
+                                                     "    }\n"
+                                                     "    return indices;\n"
+                                                     "}\n"
+                                                     "void DecodeImageQuadtree$NRect$S($P* dst,int stride,int clipX,int clipY,int clipWidth,int clipHeight,const $P* palette,const unsigned numPalette,const $T* indices,int width,int height) {\n"
+                                                     "    DecodeRect$S r;int x,y;\n$E"
+                                                     "    DecodeRectInit$S(&r,dst,stride,width,clipX,clipY,clipWidth,clipHeight);\n"
+                                                     "    for (y=0;y<height && y<r.clipY1;y+=64) {\n"
+                                                     "        for (x=0;x<width;x+=64) indices = DecodeQuadtreeNode$NRect$S(&r,height,x,y,64,palette,numPalette,indices);\n"
+                                                     "    }\n"
+                                                     "}\n"
+                                                     "\n"
+                                                     "// DecodeImageQuadtree$NRect$S(&target[targetY*targetWidth+targetX],targetWidth*sizeof($P),clipX,clipY,clipWidth,clipHeight,$L,sizeof(palette)/sizeof(palette[0]),indices,width,height);\n"
+                                                    };
+
+// Index-only decoders (--index-output): $I is the output index type (unsigned char or unsigned short)
+static const char* decodeImageIndicesUsage[] = {"void DecodeImageIndices(unsigned char* pIndicesOut,const char* indices) {\n"
+                                                "    unsigned char* pRaw = pIndicesOut;\n"
+                                                "    const char* pc;char lastChar=(char)255,c,j,hasReps=0;\n"
+                                                "    for (pc=indices;*pc!='\\0';++pc)  {\n"
+                                                "        c = *pc;if (hasReps==0 && c=='~') {hasReps=1;continue;}\n"
+                                                "        c = c>='\\\\' ? (c-'1') : (c-'0');\n"
+                                                "        if (hasReps) {\n"
+                                                "            for (j=0;j<c;j++) *pRaw++ = (unsigned char)lastChar;\n"
+                                                "            hasReps=0;continue;\n"
+                                                "        }\n"
+                                                "        *pRaw++ = (unsigned char)c;lastChar = c;\n"
+                                                "    }\n"
+                                                "}\n"
+                                                "\n"
+                                                "// unsigned char idx[width*height];  /* R8 index texture (the colors are in 'palette') */\n"
+                                                "// DecodeImageIndices(&idx[0],*indices);\n"
+                                                };
+
+static const char* decodeImageIntIndicesUsage[] = {"void DecodeImageIntIndices($I* pIndicesOut,const int* indices,const unsigned numIndices) {\n"
+                                                   "    unsigned i;$I *pRaw = pIndicesOut;\n"
+                                                   "    int lastIdx=0,idx,j;\n"
+                                                   "    for (i=0;i<numIndices;i++)  {\n"
+                                                   "        idx = indices[i];\n"
+                                                   "        if (idx<0) {for (j=0;j<-idx;j++) *pRaw++ = ($I)lastIdx;}\n"
+                                                   "        else {*pRaw++ = ($I)idx;lastIdx = idx;}\n"
+                                                   "    }\n"
+                                                   "}\n"
+                                                   "\n"
+                                                   "// $I idx[width*height];  /* index texture (the colors are in 'palette') */\n"
+                                                   "// DecodeImageIntIndices(&idx[0],indices,sizeof(indices)/sizeof(indices[0]));\n"
+                                                   };
+
+static const char* decodeImage1bppIndicesUsage[] = {"void DecodeImage1bppIndices(unsigned char* pIndicesOut,const unsigned char* indices,int width,int height) {\n"
+                                                    "    unsigned char* pRaw = pIndicesOut;\n"
+                                                    "    const int numBytesPerRow = (width+7)/8;\n"
+                                                    "    int x=0,y=0,k,numReps=0;unsigned char b=0;\n"
+                                                    "    while (y<height) {\n"
+                                                    "        if (numReps>0) --numReps;\n"
+                                                    "        else {b = *indices++;if (b==0x00 || b==0xFF) numReps = (int)(*indices++)-1;}\n"
+                                                    "        for (k=0;k<8 && x*8+k<width;k++) *pRaw++ = (unsigned char)((b>>(7-k))&1);\n"
+                                                    "        if (++x==numBytesPerRow) {x=0;++y;}\n"
+                                                    "    }\n"
+                                                    "}\n"
+                                                    "\n"
+                                                    "// unsigned char idx[width*height];  /* R8 index texture with values 0 and 1 (the colors are in 'palette') */\n"
+                                                    "// DecodeImage1bppIndices(&idx[0],indices,width,height);\n"
+                                                    };
+
+static const char* decodeImageV2IndicesUsage[] = {"void DecodeImageV2Indices($I* pIndicesOut,const char* indices) {\n"
+                                                  "    /* symbol value: '!'..'~' without '\"', ':', '?' and '\\\\' */\n"
+                                                  "#   define DECODE_V2_SYMBOL(C) ((unsigned)(C)-33U-((C)>'\"')-((C)>':')-((C)>'?')-((C)>'\\\\'))\n"
+                                                  "    const unsigned char* pc = (const unsigned char*) indices;\n"
+                                                  "    $I *pRaw = pIndicesOut,idx=0;unsigned v,numDirect,numReps,mul;\n"
+                                                  "    if (*pc!='2') return;   /* version */\n"
+                                                  "    numDirect = DECODE_V2_SYMBOL(pc[1]);pc+=2;\n"
+                                                  "    while (*pc)  {\n"
+                                                  "        v = DECODE_V2_SYMBOL(*pc);++pc;\n"
+                                                  "        if (v<numDirect) idx = ($I)v;\n"
+                                                  "        else if (v<89) {idx = ($I)(numDirect+(v-numDirect)*90+DECODE_V2_SYMBOL(*pc));++pc;}\n"
+                                                  "        else {\n"
+                                                  "            numReps=1;mul=1;\n"
+                                                  "            do {v = DECODE_V2_SYMBOL(*pc);++pc;numReps+=(v>=45?v-45:v)*mul;mul*=45;} while (v>=45);\n"
+                                                  "            while (numReps--) *pRaw++ = idx;\n"
+                                                  "            continue;\n"
+                                                  "        }\n"
+                                                  "        *pRaw++ = idx;\n"
+                                                  "    }\n"
+                                                  "#   undef DECODE_V2_SYMBOL\n"
+                                                  "}\n"
+                                                  "\n"
+                                                  "// $I idx[width*height];  /* index texture (the colors are in 'palette') */\n"
+                                                  "// DecodeImageV2Indices(&idx[0],*indices);\n"
+                                                  };
+
+static const char* decodeImageIntNarrowIndicesUsage[] = {"void DecodeImageInt$NIndices($I* pIndicesOut,const unsigned numPalette,const $T* indices,const unsigned numIndices) {\n"
+                                                         "    unsigned i,j,numReps;$I idx=0,*pRaw = pIndicesOut;\n"
+                                                         "    for (i=0;i<numIndices;i++)  {\n"
+                                                         "        if (indices[i]!=numPalette) {*pRaw++ = idx = ($I)indices[i];continue;}\n"
+                                                         "        numReps = (unsigned)indices[++i];   /* 'numPalette' is followed by the number of further repetitions */\n"
+                                                         "        for (j=0;j<numReps;j++) *pRaw++ = idx;\n"
+                                                         "    }\n"
+                                                         "}\n"
+                                                         "\n"
+                                                         "// $I idx[width*height];  /* index texture (the colors are in 'palette') */\n"
+                                                         "// DecodeImageInt$NIndices(&idx[0],sizeof(palette)/sizeof(palette[0]),indices,sizeof(indices)/sizeof(indices[0]));\n"
+                                                         };
+
+static const char* decodeImageQuadtreeIndicesUsage[] = {"const $T* DecodeQuadtreeNode$NIndices($I* pIndicesOut,int width,int height,int x,int y,int size,const unsigned numPalette,const $T* indices) {\n"
+                                                        "    if (*indices==numPalette) {\n"
+                                                        "        const int half = size/2;\n"
+                                                        "        indices = DecodeQuadtreeNode$NIndices(pIndicesOut,width,height,x,y,half,numPalette,indices+1);\n"
+                                                        "        if (x+half<width) indices = DecodeQuadtreeNode$NIndices(pIndicesOut,width,height,x+half,y,half,numPalette,indices);\n"
+                                                        "        if (y+half<height) {\n"
+                                                        "            indices = DecodeQuadtreeNode$NIndices(pIndicesOut,width,height,x,y+half,half,numPalette,indices);\n"
+                                                        "            if (x+half<width) indices = DecodeQuadtreeNode$NIndices(pIndicesOut,width,height,x+half,y+half,half,numPalette,indices);\n"
+                                                        "        }\n"
+                                                        "    }\n"
+                                                        "    else {\n"
+                                                        "        const $I value = ($I)*indices;\n"
+                                                        "        const int w = x+size<width ? size : width-x, h = y+size<height ? size : height-y;\n"
+                                                        "        $I* pRaw = &pIndicesOut[y*width+x];int i,j;\n"
+                                                        "        for (j=0;j<h;j++,pRaw+=width) {for (i=0;i<w;i++) pRaw[i] = value;}   /* (the inner loop becomes wide stores) */\n"
+                                                        "        ++indices;\n"
+                                                        "    }\n"
+                                                        "    return indices;\n"
+                                                        "}\n"
+                                                        "void DecodeImageQuadtree$NIndices($I* pIndicesOut,const unsigned numPalette,const $T* indices,int width,int height) {\n"
+                                                        "    int x,y;\n"
+                                                        "    for (y=0;y<height;y+=64) {\n"
+                                                        "        for (x=0;x<width;x+=64) indices = DecodeQuadtreeNode$NIndices(pIndicesOut,width,height,x,y,64,numPalette,indices);\n"
+                                                        "    }\n"
+                                                        "}\n"
+                                                        "\n"
+                                                        "// $I idx[width*height];  /* index texture (the colors are in 'palette') */\n"
+                                                        "// DecodeImageQuadtree$NIndices(&idx[0],sizeof(palette)/sizeof(palette[0]),indices,width,height);\n"
+                                                       };
+
+static const char* blitSpriteIndicesUsage[] = {"void BlitSprite$NIndices($I* dst,int stride,int x,int y,const $T* spans,int height) {\n"
+                                               "    int row,numSpans,i,len;\n"
+                                               "    for (row=0;row<height;row++) {\n"
+                                               "        $I* pRow = ($I*)((unsigned char*)dst+(y+row)*stride)+x;\n"
+                                               "        for (numSpans=(int)*spans++;numSpans>0;--numSpans) {\n"
+                                               "            $I* p = pRow+*spans++;\n"
+                                               "            len = (int)*spans++;\n"
+                                               "            for (i=0;i<len;i++) p[i] = ($I)spans[i];\n"
+                                               "            spans+=len;\n"
+                                               "        }\n"
+                                               "    }\n"
+                                               "}\n"
+                                               "\n"
+                                               "// BlitSprite$NIndices(&indexTarget[0],indexTargetWidth*sizeof($I),spriteX,spriteY,indices,height);  /* index texture (the colors are in 'palette') */\n"
+                                              };
+
+// Reference decoders of the block compressed textures (the first part of each decoder is shared)
+static const char* decodeBC1ColorsUsage[] = {"void DecodeBC1Colors(unsigned* colors,const unsigned char* block,int fourColors) {\n"
+                                             "    const unsigned c0 = block[0]|(block[1]<<8), c1 = block[2]|(block[3]<<8);\n"
+                                             "    unsigned char rgb[2][3];int i;\n"
+                                             "    rgb[0][0]=(unsigned char)(((c0>>11)<<3)|(c0>>13));rgb[0][1]=(unsigned char)((((c0>>5)&63)<<2)|(((c0>>5)&63)>>4));rgb[0][2]=(unsigned char)(((c0&31)<<3)|((c0&31)>>2));\n"
+                                             "    rgb[1][0]=(unsigned char)(((c1>>11)<<3)|(c1>>13));rgb[1][1]=(unsigned char)((((c1>>5)&63)<<2)|(((c1>>5)&63)>>4));rgb[1][2]=(unsigned char)(((c1&31)<<3)|((c1&31)>>2));\n"
+                                             "    if (!fourColors && c0>c1) fourColors = 1;  /* BC1: c0<=c1 selects the 3-color mode (index 3 is transparent black) */\n"
+                                             "    colors[0]=colors[1]=colors[2]=0xFF000000U;colors[3] = fourColors ? 0xFF000000U : 0;\n"
+                                             "    for (i=0;i<3;i++) {\n"
+                                             "        colors[0]|=(unsigned)rgb[0][i]<<(8*i);colors[1]|=(unsigned)rgb[1][i]<<(8*i);\n"
+                                             "        if (fourColors) {colors[2]|=(unsigned)((2*rgb[0][i]+rgb[1][i])/3)<<(8*i);colors[3]|=(unsigned)((rgb[0][i]+2*rgb[1][i])/3)<<(8*i);}\n"
+                                             "        else colors[2]|=(unsigned)((rgb[0][i]+rgb[1][i])/2)<<(8*i);\n"
+                                             "    }\n"
+                                             "}\n"
+                                             };
+
+static const char* decodeBC1Usage[] = {"void DecodeBC1(unsigned* pPixelsOut,const unsigned char* blocks,int width,int height) {\n"
+                                       "    unsigned colors[4],bits;int bx,by,x,y,k;\n"
+                                       "    for (by=0;by<height;by+=4) {\n"
+                                       "        for (bx=0;bx<width;bx+=4,blocks+=8) {\n"
+                                       "            DecodeBC1Colors(colors,blocks,0);\n"
+                                       "            bits = blocks[4]|(blocks[5]<<8)|(blocks[6]<<16)|((unsigned)blocks[7]<<24);\n"
+                                       "            for (k=0;k<16;k++,bits>>=2) {\n"
+                                       "                x=bx+k%4;y=by+k/4;\n"
+                                       "                if (x<width && y<height) pPixelsOut[y*width+x] = colors[bits&3];\n"
+                                       "            }\n"
+                                       "        }\n"
+                                       "    }\n"
+                                       "}\n"
+                                       "\n"
+                                       "// unsigned int raw[width*height];\n"
+                                       "// DecodeBC1(&raw[0],blocks,width,height);\n"
+                                       };
+
+static const char* decodeBC3Usage[] = {"void DecodeBC3(unsigned* pPixelsOut,const unsigned char* blocks,int width,int height) {\n"
+                                       "    unsigned colors[4],bits,alphas[8],alphaBits;int bx,by,x,y,k;\n"
+                                       "    for (by=0;by<height;by+=4) {\n"
+                                       "        for (bx=0;bx<width;bx+=4,blocks+=16) {\n"
+                                       "            alphas[0]=blocks[0];alphas[1]=blocks[1];\n"
+                                       "            if (alphas[0]>alphas[1]) {for (k=2;k<8;k++) alphas[k] = ((8-k)*alphas[0]+(k-1)*alphas[1])/7;}\n"
+                                       "            else {for (k=2;k<6;k++) alphas[k] = ((6-k)*alphas[0]+(k-1)*alphas[1])/5;alphas[6]=0;alphas[7]=255;}\n"
+                                       "            DecodeBC1Colors(colors,&blocks[8],1);\n"
+                                       "            bits = blocks[12]|(blocks[13]<<8)|(blocks[14]<<16)|((unsigned)blocks[15]<<24);\n"
+                                       "            alphaBits = blocks[2]|(blocks[3]<<8)|(blocks[4]<<16);   /* 3 bits per pixel (pixels 0-7, then 8-15) */\n"
+                                       "            for (k=0;k<16;k++,bits>>=2,alphaBits>>=3) {\n"
+                                       "                if (k==8) alphaBits = blocks[5]|(blocks[6]<<8)|(blocks[7]<<16);\n"
+                                       "                x=bx+k%4;y=by+k/4;\n"
+                                       "                if (x<width && y<height) pPixelsOut[y*width+x] = (colors[bits&3]&0x00FFFFFF)|(alphas[alphaBits&7]<<24);\n"
+                                       "            }\n"
+                                       "        }\n"
+                                       "    }\n"
+                                       "}\n"
+                                       "\n"
+                                       "// unsigned int raw[width*height];\n"
+                                       "// DecodeBC3(&raw[0],blocks,width,height);\n"
+                                       };
+
+static const char* decodeETC2ColorBlockUsage[] = {"/* Decodes the ETC1-compatible individual and differential modes of an ETC2 color block (the only ones written by pngEmbedder) */\n"
+                                                  "void DecodeETC2ColorBlock(unsigned* pBlockOut,const unsigned char* block) {\n"
+                                                  "    static const int modifiers[8][2] = {{2,8},{5,17},{9,29},{13,42},{18,60},{24,80},{33,106},{47,183}};\n"
+                                                  "    const unsigned bits = ((unsigned)block[4]<<24)|(block[5]<<16)|(block[6]<<8)|block[7];\n"
+                                                  "    int base[2][3],i,k,x,y,sub,m,c;\n"
+                                                  "    for (i=0;i<3;i++) {\n"
+                                                  "        if (block[3]&2) {   /* differential mode: 5-bit color and 3-bit signed delta */\n"
+                                                  "            c = block[i]>>3;base[0][i] = (c<<3)|(c>>2);\n"
+                                                  "            c += ((block[i]&7)^4)-4;base[1][i] = (c<<3)|(c>>2);\n"
+                                                  "        }\n"
+                                                  "        else {base[0][i] = (block[i]&0xF0)|(block[i]>>4);base[1][i] = ((block[i]&0x0F)<<4)|(block[i]&0x0F);}\n"
+                                                  "    }\n"
+                                                  "    for (k=0;k<16;k++) {\n"
+                                                  "        x=k/4;y=k%4;   /* pixels are stored column by column */\n"
+                                                  "        sub = (block[3]&1) ? (y>=2) : (x>=2);\n"
+                                                  "        m = modifiers[sub ? (block[3]>>2)&7 : block[3]>>5][(bits>>k)&1];\n"
+                                                  "        if ((bits>>(16+k))&1) m=-m;\n"
+                                                  "        pBlockOut[y*4+x] = 0xFF000000U;\n"
+                                                  "        for (i=0;i<3;i++) {c = base[sub][i]+m;pBlockOut[y*4+x] |= (unsigned)(c<0 ? 0 : (c>255 ? 255 : c))<<(8*i);}\n"
+                                                  "    }\n"
+                                                  "}\n"
+                                                  };
+
+static const char* decodeETC2Usage[] = {"void DecodeETC2(unsigned* pPixelsOut,const unsigned char* blocks,int width,int height) {\n"
+                                        "    unsigned pixels[16];int bx,by,x,y,k;\n"
+                                        "    for (by=0;by<height;by+=4) {\n"
+                                        "        for (bx=0;bx<width;bx+=4,blocks+=8) {\n"
+                                        "            DecodeETC2ColorBlock(pixels,blocks);\n"
+                                        "            for (k=0;k<16;k++) {\n"
+                                        "                x=bx+k%4;y=by+k/4;\n"
+                                        "                if (x<width && y<height) pPixelsOut[y*width+x] = pixels[k];\n"
+                                        "            }\n"
+                                        "        }\n"
+                                        "    }\n"
+                                        "}\n"
+                                        "\n"
+                                        "// unsigned int raw[width*height];\n"
+                                        "// DecodeETC2(&raw[0],blocks,width,height);\n"
+                                        };
+
+static const char* decodeETC2EACUsage[] = {"void DecodeETC2_EAC(unsigned* pPixelsOut,const unsigned char* blocks,int width,int height) {\n"
+                                           "    static const signed char modifiers[16][8] = {{-3,-6,-9,-15,2,5,8,14},{-3,-7,-10,-13,2,6,9,12},{-2,-5,-8,-13,1,4,7,12},{-2,-4,-6,-13,1,3,5,12},\n"
+                                           "                                                 {-3,-6,-8,-12,2,5,7,11},{-3,-7,-9,-11,2,6,8,10},{-4,-7,-8,-11,3,6,7,10},{-3,-5,-8,-11,2,4,7,10},\n"
+                                           "                                                 {-2,-6,-8,-10,1,5,7,9},{-2,-5,-8,-10,1,4,7,9},{-2,-4,-8,-10,1,3,7,9},{-2,-5,-7,-10,1,4,6,9},\n"
+                                           "                                                 {-3,-4,-7,-10,2,3,6,9},{-1,-2,-3,-10,0,1,2,9},{-4,-6,-8,-9,3,5,7,8},{-3,-5,-7,-9,2,4,6,8}};\n"
+                                           "    unsigned pixels[16],alphaBits=0;int bx,by,x,y,k,a;\n"
+                                           "    for (by=0;by<height;by+=4) {\n"
+                                           "        for (bx=0;bx<width;bx+=4,blocks+=16) {\n"
+                                           "            DecodeETC2ColorBlock(pixels,&blocks[8]);   /* the EAC alpha block comes first */\n"
+                                           "            for (k=0;k<16;k++) {\n"
+                                           "                if (k%8==0) alphaBits = (blocks[2+k/8*3]<<16)|(blocks[3+k/8*3]<<8)|blocks[4+k/8*3];   /* 3 bits per pixel, column by column */\n"
+                                           "                a = blocks[0]+modifiers[blocks[1]&15][(alphaBits>>(21-3*(k%8)))&7]*(blocks[1]>>4);\n"
+                                           "                x=bx+k/4;y=by+k%4;\n"
+                                           "                if (x<width && y<height) pPixelsOut[y*width+x] = (pixels[(k%4)*4+k/4]&0x00FFFFFF)|((unsigned)(a<0 ? 0 : (a>255 ? 255 : a))<<24);\n"
+                                           "            }\n"
+                                           "        }\n"
+                                           "    }\n"
+                                           "}\n"
+                                           "\n"
+                                           "// unsigned int raw[width*height];\n"
+                                           "// DecodeETC2_EAC(&raw[0],blocks,width,height);\n"
+                                           };
+
+// Appended to the usage when --tiles is used ($T and $N are the pixel type and the suffix of the decoder name)
+static const char* expandTilemapUsage[] = {"\n"
+                                           "void ExpandTilemap$N($T* pPixelsOut,const $T* tileset,const unsigned short* tilemap,int tileSize,int tilemapWidth,int tilemapHeight) {\n"
+                                           "    const int rowStride = tileSize*tilemapWidth, tileArea = tileSize*tileSize;\n"
+                                           "    int tx,ty,x,y,u,v,t;\n"
+                                           "    for (ty=0;ty<tilemapHeight;ty++) {\n"
+                                           "        for (tx=0;tx<tilemapWidth;tx++) {\n"
+                                           "            const unsigned short e = *tilemap++;\n"
+                                           "            const $T* tile = &tileset[(e&0x1FFF)*tileArea];\n"
+                                           "            $T* pRaw = &pPixelsOut[ty*tileSize*rowStride+tx*tileSize];\n"
+                                           "            for (y=0;y<tileSize;y++,pRaw+=rowStride) {\n"
+                                           "                for (x=0;x<tileSize;x++) {\n"
+                                           "                    u = (e&0x2000) ? tileSize-1-x : x;v = (e&0x4000) ? tileSize-1-y : y;\n"
+                                           "                    if (e&0x8000) {t=u;u=v;v=t;}   /* transposed tile */\n"
+                                           "                    pRaw[x] = tile[v*tileSize+u];\n"
+                                           "                }\n"
+                                           "            }\n"
+                                           "        }\n"
+                                           "    }\n"
+                                           "}\n"
+                                           "\n"
+                                           "// $T tileset[width*height];    /* decoded with the function above */\n"
+                                           "// $T raw[tileSize*tilemapWidth*tileSize*tilemapHeight];\n"
+                                           "// ExpandTilemap$N(&raw[0],tileset,tilemap,tileSize,tilemapWidth,tilemapHeight);\n"
+                                           };
+
+// Appended to the usage when --scan does not keep the row-major order (only the one for 'scanOrder' is written)
+static const char* unscanColumnUsage[] = {"\n"
+                                          "/* The indices are in column-major order: this puts the decoded pixels back in rows */\n"
+                                          "void UnscanImage$N($T* pPixelsOut,const $T* scanned,int width,int height) {\n"
+                                          "    int x,y;$T* pRaw;\n"
+                                          "    for (x=0;x<width;x++) {\n"
+                                          "        for (y=0,pRaw=&pPixelsOut[x];y<height;y++,pRaw+=width) *pRaw = *scanned++;\n"
+                                          "    }\n"
+                                          "}\n"
+                                          "\n"
+                                          "// $T scanned[width*height];    /* decoded with the function above */\n"
+                                          "// $T raw[width*height];\n"
+                                          "// UnscanImage$N(&raw[0],scanned,width,height);\n"
+                                          };
+static const char* unscanSerpentineUsage[] = {"\n"
+                                              "/* The indices are in serpentine order (odd rows go from right to left): this puts the decoded pixels back in rows */\n"
+                                              "void UnscanImage$N($T* pPixelsOut,const $T* scanned,int width,int height) {\n"
+                                              "    int x,y;$T* pRaw = pPixelsOut;\n"
+                                              "    for (y=0;y<height;y++,pRaw+=width) {\n"
+                                              "        if (y&1) {for (x=width-1;x>=0;x--) pRaw[x] = *scanned++;}\n"
+                                              "        else {for (x=0;x<width;x++) pRaw[x] = *scanned++;}\n"
+                                              "    }\n"
+                                              "}\n"
+                                              "\n"
+                                              "// $T scanned[width*height];    /* decoded with the function above */\n"
+                                              "// $T raw[width*height];\n"
+                                              "// UnscanImage$N(&raw[0],scanned,width,height);\n"
+                                              };
+static const char* unscanHilbertUsage[] = {"\n"
+                                           "/* The indices are in 16x16 tiles (in row-major order), each one along a Hilbert curve (pixels outside the image are skipped):\n"
+                                           "   this puts the decoded pixels back in rows, one tile at a time */\n"
+                                           "void UnscanImage$N($T* pPixelsOut,const $T* scanned,int width,int height) {\n"
+                                           "    unsigned char curve[256][2];int d,s,t,rx,ry,tmp,x,y,tx,ty;\n"
+                                           "    for (d=0;d<256;d++) {\n"
+                                           "        for (s=1,t=d,x=y=0;s<16;s*=2,t/=4) {\n"
+                                           "            rx = 1&(t/2);ry = 1&(t^rx);\n"
+                                           "            if (ry==0) {if (rx==1) {x=s-1-x;y=s-1-y;} tmp=x;x=y;y=tmp;}\n"
+                                           "            x+=s*rx;y+=s*ry;\n"
+                                           "        }\n"
+                                           "        curve[d][0]=(unsigned char)x;curve[d][1]=(unsigned char)y;\n"
+                                           "    }\n"
+                                           "    for (ty=0;ty<height;ty+=16) {\n"
+                                           "        for (tx=0;tx<width;tx+=16) {\n"
+                                           "            $T* pTile = &pPixelsOut[ty*width+tx];\n"
+                                           "            if (tx+16<=width && ty+16<=height) {for (d=0;d<256;d++) pTile[curve[d][1]*width+curve[d][0]] = *scanned++;}\n"
+                                           "            else {\n"
+                                           "                for (d=0;d<256;d++) {\n"
+                                           "                    if (tx+curve[d][0]<width && ty+curve[d][1]<height) pTile[curve[d][1]*width+curve[d][0]] = *scanned++;\n"
+                                           "                }\n"
+                                           "            }\n"
+                                           "        }\n"
+                                           "    }\n"
+                                           "}\n"
+                                           "\n"
+                                           "// $T scanned[width*height];    /* decoded with the function above */\n"
+                                           "// $T raw[width*height];\n"
+                                           "// UnscanImage$N(&raw[0],scanned,width,height);\n"
+                                           };
+
+
+
 
 
 
@@ -78,246 +937,2320 @@ static const char* decodeImageIntUsage[] = {"void DecodeImageInt(unsigned* pPixe
 typedef struct {
     unsigned int color;
     unsigned long reps;
+    unsigned long firstIndex;   // index of the first pixel with this color (makes sorting deterministic)
 } PaletteEntry;
 static __inline int PaletteEntryCmp(const void* pa,const void* pb) {
-    const unsigned long* pra = &((const PaletteEntry*)pa)->reps;
-    const unsigned long* prb = &((const PaletteEntry*)pb)->reps;
-    return (*pra<*prb ? 1 : (*pra>*prb ? -1 : 0));
+    const PaletteEntry* a = (const PaletteEntry*)pa;
+    const PaletteEntry* b = (const PaletteEntry*)pb;
+    if (a->reps!=b->reps) return (a->reps<b->reps ? 1 : -1);
+    return (a->firstIndex<b->firstIndex ? -1 : (a->firstIndex>b->firstIndex ? 1 : 0));
 }
 
 
-int main(int argc,char* argv[]) {
-    const char* filename = NULL;
-    char savename[2049] = "";
-    int i,j;FILE* f = NULL;
-    const int numCharsPerLine = 800;int numChars=0;
-    unsigned long cnt=0,numReps=0;char lastChar='+',curChar='+';
-    int lastIdx=-1;
-    int flipOptionUsed = 0;
+// Single-channel content: gray images (R==G==B, A==255) and alpha masks (constant RGB) can use an 8-bit palette.
+// We just need to check the palette, since it contains every color of the image.
+enum {PIXEL_FORMAT_RGBA=0,PIXEL_FORMAT_R8,PIXEL_FORMAT_A8};
+static int DetectSingleChannelPixelFormat(const PaletteEntry* palette,int numPaletteColors) {
+    int j,isGray=1,isAlpha=1;
+    for (j=0;j<numPaletteColors;j++) {
+        const unsigned color = palette[j].color;
+        const unsigned r = color&0xFF, g = (color>>8)&0xFF, b = (color>>16)&0xFF, a = color>>24;
+        if (r!=g || r!=b || a!=255) isGray=0;
+        if ((color&0x00FFFFFF)!=(palette[0].color&0x00FFFFFF)) isAlpha=0;
+    }
+    return isGray ? PIXEL_FORMAT_R8 : (isAlpha ? PIXEL_FORMAT_A8 : PIXEL_FORMAT_RGBA);
+}
+static __inline unsigned char GetSingleChannelValue(unsigned color,int pixelFormat) {
+    return (unsigned char) (pixelFormat==PIXEL_FORMAT_A8 ? (color>>24) : (color&0xFF));
+}
+
 
+// Minimal ParallelFor(...): job i runs on thread (i%numThreads). Every job must write to its own output slot.
+#ifndef MAX_NUM_THREADS
+#   define MAX_NUM_THREADS (64)
+#endif
+typedef void (*ParallelJobFunc)(void* userData,int jobIndex);
+typedef struct {
+    ParallelJobFunc func;
+    void* userData;
+    int numJobs,numThreads,threadIndex;
+} ParallelForArgs;
+static void RunParallelJobs(ParallelForArgs* a) {
+    int i;for (i=a->threadIndex;i<a->numJobs;i+=a->numThreads) a->func(a->userData,i);
+}
+#ifndef PNGEMBEDDER_NO_THREADS
+#   ifdef _WIN32
+static DWORD WINAPI ParallelForThreadProc(LPVOID p) {RunParallelJobs((ParallelForArgs*)p);return 0;}
+#   else
+static void* ParallelForThreadProc(void* p) {RunParallelJobs((ParallelForArgs*)p);return NULL;}
+#   endif
+#endif
+static int GetNumHardwareThreads(void) {
+    int n = 1;
+#   ifndef PNGEMBEDDER_NO_THREADS
+#       ifdef _WIN32
+    SYSTEM_INFO si;GetSystemInfo(&si);n = (int) si.dwNumberOfProcessors;
+#       else
+    n = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#       endif
+#   endif
+    return n<1 ? 1 : (n>MAX_NUM_THREADS ? MAX_NUM_THREADS : n);
+}
+static void ParallelFor(int numJobs,ParallelJobFunc func,void* userData,int numThreads) {
+    ParallelForArgs args[MAX_NUM_THREADS];
+    int t,numStarted=1;
+    if (numThreads>numJobs) numThreads=numJobs;
+    if (numThreads>MAX_NUM_THREADS) numThreads=MAX_NUM_THREADS;
+    if (numThreads<1) numThreads=1;
+    for (t=0;t<numThreads;t++) {args[t].func=func;args[t].userData=userData;args[t].numJobs=numJobs;args[t].numThreads=numThreads;args[t].threadIndex=t;}
+#   ifndef PNGEMBEDDER_NO_THREADS
     {
-        flipOptionUsed = (argc==3 && (strlen(argv[1])==2 && argv[1][0]=='-' && argv[1][1]=='f'));
-        if (argc<2 || argc>3 || (argc==3 && !flipOptionUsed)) {
-            printf("pngEmbedder embeds a paletted png into C/C++ source code.\n");
-            printf("USAGE: pngEmbedder inputFile.png\n");
-            printf("FLIPY: pngEmbedder -f inputFile.png\n");
-            printf("Tip: use: pngnq -n 75 inputFile.png\n");
-            printf("to get a suitable paletted image.\n");
-            return -1;
+#       ifdef _WIN32
+        HANDLE threads[MAX_NUM_THREADS];
+        for (t=1;t<numThreads;t++) {
+            threads[t] = CreateThread(NULL,0,ParallelForThreadProc,&args[t],0,NULL);
+            if (!threads[t]) break;
         }
-#       ifndef INVERT_FLIPY_DEFAULT
-        stbi_set_flip_vertically_on_load(flipOptionUsed);
+        numStarted = t;
+        for (t=numStarted;t<numThreads;t++) RunParallelJobs(&args[t]);  // fallback: run them here
+        RunParallelJobs(&args[0]);
+        for (t=1;t<numStarted;t++) {WaitForSingleObject(threads[t],INFINITE);CloseHandle(threads[t]);}
 #       else
-        stbi_set_flip_vertically_on_load(!flipOptionUsed);
+        pthread_t threads[MAX_NUM_THREADS];
+        for (t=1;t<numThreads;t++) {
+            if (pthread_create(&threads[t],NULL,ParallelForThreadProc,&args[t])!=0) break;
+        }
+        numStarted = t;
+        for (t=numStarted;t<numThreads;t++) RunParallelJobs(&args[t]);  // fallback: run them here
+        RunParallelJobs(&args[0]);
+        for (t=1;t<numStarted;t++) pthread_join(threads[t],NULL);
 #       endif
+    }
+#   else
+    for (t=0;t<numThreads;t++) RunParallelJobs(&args[t]);
+    (void)numStarted;
+#   endif
+}
 
-        filename = argv[argc-1];
 
-        if (strlen(filename)+4>=2048) {
-            printf("Error input file path is too long.\n");
-            return -1;
-        }
-        strcpy(savename,filename);
-        strcat(savename,".inl");
+// Phase timings (for --stats and --trace): spans are recorded by the main thread only
+#ifndef MAX_NUM_TRACE_SPANS
+#   define MAX_NUM_TRACE_SPANS (64)
+#endif
+typedef struct {
+    const char* name;
+    double startMs,durationMs;
+} TraceSpan;
+static TraceSpan traceSpans[MAX_NUM_TRACE_SPANS];
+static int numTraceSpans = 0;
+static double GetTimeMs(void) {
+#   ifdef _WIN32
+    LARGE_INTEGER counter,frequency;
+    QueryPerformanceCounter(&counter);QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart*1000.0/(double)frequency.QuadPart;
+#   else
+    struct timespec ts;clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec*1000.0+(double)ts.tv_nsec/1000000.0;
+#   endif
+}
+static int TraceBegin(const char* name) {
+    TraceSpan* ts;
+    if (numTraceSpans>=MAX_NUM_TRACE_SPANS) return -1;
+    ts = &traceSpans[numTraceSpans];
+    ts->name=name;ts->durationMs=0;ts->startMs=GetTimeMs();
+    return numTraceSpans++;
+}
+static void TraceEnd(int span) {
+    if (span>=0) traceSpans[span].durationMs = GetTimeMs()-traceSpans[span].startMs;
+}
+// Returns the peak resident set size in Kb (or 0 if unknown)
+static long GetPeakRSSKb(void) {
+#   ifndef _WIN32
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF,&ru)!=0) return 0;
+#       ifdef __APPLE__
+    return (long) (ru.ru_maxrss/1024);   // in bytes on macOS
+#       else
+    return (long) ru.ru_maxrss;
+#       endif
+#   else
+    return 0;
+#   endif
+}
+// Writes all the spans as Chrome trace-event JSON (chrome://tracing or https://ui.perfetto.dev)
+static int WriteTraceFile(const char* path) {
+    int i;FILE* tf = fopen(path,"wt");
+    if (!tf) return 0;
+    fprintf(tf,"{\"traceEvents\":[\n");
+    for (i=0;i<numTraceSpans;i++) {
+        const TraceSpan* ts = &traceSpans[i];
+        fprintf(tf,"{\"name\":\"%s\",\"cat\":\"pngEmbedder\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}%s\n",
+                ts->name,(ts->startMs-traceSpans[0].startMs)*1000.0,ts->durationMs*1000.0,i<numTraceSpans-1?",":"");
     }
+    fprintf(tf,"],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(tf);
+    return 1;
+}
+static void PrintStats(FILE* msg,long bytesIn,long bytesOut) {
+    int i;const long peakRSSKb = GetPeakRSSKb();
+    fprintf(msg,"%-12s %10s\n","PHASE","TIME (ms)");
+    for (i=0;i<numTraceSpans;i++) fprintf(msg,"%-12s %10.3f\n",traceSpans[i].name,traceSpans[i].durationMs);
+    fprintf(msg,"Bytes in: %ld  Bytes out: ",bytesIn);
+    if (bytesOut>=0) fprintf(msg,"%ld",bytesOut);
+    else fprintf(msg,"n/a");
+    if (peakRSSKb>0) fprintf(msg,"  Peak RSS: %ld Kb",peakRSSKb);
+    fprintf(msg,"\n");
+}
+// Prints --stats and saves --trace, also when main(...) stops with an error (bytesOut<0 when there's no output)
+static void ReportStats(FILE* msg,int statsOptionUsed,const char* tracePath,long bytesIn,long bytesOut) {
+    int i;
+    for (i=0;i<numTraceSpans;i++) {if (traceSpans[i].durationMs==0) TraceEnd(i);}   // (closes the span an error path left open)
+    if (statsOptionUsed) PrintStats(msg,bytesIn,bytesOut);
+    if (tracePath && !WriteTraceFile(tracePath)) fprintf(msg,"Error: cannot save file: \"%s\".\n",tracePath);
+}
 
-#   ifdef NEVER
-    const int numVarNames = 26 /* A-Z */ + 24 /* a-z without i,j */ + 52 * (26*2+10);   // = 3274
-    char varNames[numVarNames][3];
-    {
-        int cnt=0;
-        for (i=0;i<26;i++) {varNames[cnt][0]=(char)(i+'A');varNames[cnt++][1]='\0';}
-        for (i=0;i<26;i++) {
-            if ((char)(i+'a') == 'i' || (char)(i+'a')=='j') continue;
-            varNames[cnt][0]=(char)(i+'a');
-            varNames[cnt++][1]='\0';
+
+// The input file is memory-mapped when possible (and read into memory otherwise, e.g. from stdin when its path is "-")
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    int isMapped;
+#   ifdef _WIN32
+    HANDLE file,mapping;
+#   endif
+} InputFile;
+static int InputFileReadAll(InputFile* in,FILE* fin) {
+    size_t capacity = 1<<16,n;
+    in->data = (unsigned char*) malloc(capacity);in->size = 0;in->isMapped = 0;
+    while (in->data && (n=fread(&in->data[in->size],1,capacity-in->size,fin))>0) {
+        in->size+=n;
+        if (in->size==capacity) {
+            unsigned char* newData = (unsigned char*) realloc(in->data,capacity*2);
+            if (!newData) {free(in->data);in->data=NULL;break;}
+            in->data = newData;capacity*=2;
         }
-        for (i=0;i<52;i++) {
-            for (j=0;j<62;j++) {
-                varNames[cnt][0]=(char)(i<26?(i+'A'):(i-26+'a'));
-                varNames[cnt][1]=(char)(j<26?(j+'A'):(j<52?(j-26+'a'):(j-52+'0')));
-                varNames[cnt++][2]='\0';
+    }
+    return in->data!=NULL;
+}
+static int InputFileOpen(InputFile* in,const char* path) {
+    memset(in,0,sizeof(*in));
+    if (strcmp(path,"-")==0) {
+#       ifdef _WIN32
+        _setmode(_fileno(stdin),_O_BINARY);
+#       endif
+        return InputFileReadAll(in,stdin);
+    }
+#   ifdef _WIN32
+    in->file = CreateFileA(path,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+    if (in->file!=INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(in->file,&size) && size.QuadPart>0) {
+            in->mapping = CreateFileMappingA(in->file,NULL,PAGE_READONLY,0,0,NULL);
+            if (in->mapping) {
+                in->data = (unsigned char*) MapViewOfFile(in->mapping,FILE_MAP_READ,0,0,0);
+                if (in->data) {in->size=(size_t)size.QuadPart;in->isMapped=1;return 1;}
+                CloseHandle(in->mapping);
             }
         }
-        ASSERT(cnt==numVarNames);
-        //for (i=0;i<numVarNames;i++) printf("%d)\t\"%s\"\n",i,varNames[i]);
+        CloseHandle(in->file);
     }
-#   endif //NEVER
-
-    int w=0,h=0,c=0,area=0;
-    unsigned char* raw = stbi_load(filename,&w,&h,&c,4);
+#   else
     {
-        if (!raw) {
-            printf("Filename \"%s\" invalid (not found or invalid image file).\n",filename);
-            return -2;
+        const int fd = open(path,O_RDONLY);
+        if (fd>=0) {
+            struct stat st;
+            if (fstat(fd,&st)==0 && st.st_size>0) {
+                void* p = mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+                if (p!=MAP_FAILED) {in->data=(unsigned char*)p;in->size=(size_t)st.st_size;in->isMapped=1;}
+            }
+            close(fd);  // the mapping stays valid
+            if (in->isMapped) return 1;
         }
-        if (c!=4) printf("Converting \"%s\" to RGBA (the only supported number of channels).\n",filename);
-        area=w*h;
     }
+#   endif
+    {
+        FILE* fin = fopen(path,"rb");int ok;
+        if (!fin) return 0;
+        ok = InputFileReadAll(in,fin);
+        fclose(fin);
+        return ok;
+    }
+}
+static void InputFileClose(InputFile* in) {
+    if (in->data) {
+#       ifdef _WIN32
+        if (in->isMapped) {UnmapViewOfFile(in->data);CloseHandle(in->mapping);CloseHandle(in->file);}
+#       else
+        if (in->isMapped) munmap(in->data,in->size);
+#       endif
+        else free(in->data);
+    }
+    memset(in,0,sizeof(*in));
+}
 
-    const int maxNumPaletteEntries = 500;
-    PaletteEntry palette[maxNumPaletteEntries];
-    int numPaletteColors = 0;
-    for (i=0;i<maxNumPaletteEntries;i++) {palette[i].color=0;palette[i].reps=0;}
-    const unsigned int* pRaw = (const unsigned int*) raw;
-    for (i=0;i<area;i++) {
-        if (numPaletteColors+1>=maxNumPaletteEntries) {
-            printf("Error: Too many colors in input image. Please use pngnq to reduce them.\n");
-            if (raw) {STBI_FREE(raw);raw=NULL;}
-            return -3;
-        }
-        ASSERT(numPaletteColors+1<maxNumPaletteEntries);    // Otherwise we should increase maxNumPaletteEntries
-        for (j=0;j<numPaletteColors+1;j++) {
-            PaletteEntry* pe = &palette[j];
-            if (pe->reps==0) {
-                ++pe->reps;
-                pe->color=*pRaw;
-                numPaletteColors=j+1;
-                break;
-            }
-            if (pe->color==*pRaw) {++pe->reps;break;}
+
+// --trim: every fully transparent pixel becomes 0 (one palette entry), then fully transparent borders are cropped.
+// Returns the new area (the cropped image is moved to the start of 'pixels').
+static int TrimTransparentPixels(unsigned* pixels,int* pw,int* ph,int* pTrimX,int* pTrimY) {
+    const int w = *pw, h = *ph;
+    int x,y,x0=w,y0=h,x1=-1,y1=-1;
+    for (y=0;y<h;y++) {
+        unsigned* row = &pixels[y*w];
+        for (x=0;x<w;x++) {
+            if ((row[x]>>24)==0) {row[x]=0;continue;}
+            if (x0>x) x0=x;
+            if (x1<x) x1=x;
+            if (y0>y) y0=y;
+            y1=y;
         }
-        ++pRaw;
     }
-    qsort(&palette[0],numPaletteColors,sizeof(PaletteEntry),&PaletteEntryCmp);
-    /*for (j=0;j<numPaletteColors;j++) {
-        PaletteEntry* pe = &palette[j];
-        printf("palette[%d] = %uU (reps=%lu)\n",j,pe->color,pe->reps);
-    }*/
+    if (x1<0) {x0=y0=x1=y1=0;}  // fully transparent image: we keep one pixel
+    *pTrimX=x0;*pTrimY=y0;*pw=x1-x0+1;*ph=y1-y0+1;
+    for (y=y0;y<=y1;y++) memmove(&pixels[(y-y0)*(*pw)],&pixels[y*w+x0],(*pw)*sizeof(unsigned));
+    return (*pw)*(*ph);
+}
 
-    if (numPaletteColors==0) {
-        printf("Error: numPaletteColors==0.\n");
-        if (raw) {STBI_FREE(raw);raw=NULL;}
-        return -4;
-    }
 
-    f = fopen(savename,"wt");
-    if (!f) {
-        printf("Error: cannot save file: \"%s\".\n",savename);
-        if (raw) {STBI_FREE(raw);raw=NULL;}
-        return -5;
+// --tiles=N: the image is sliced into NxN tiles and exact duplicates are stored once (optionally also flipped or transposed duplicates)
+#define TILEMAP_MAX_NUM_TILES   (8192)          // tilemap entries: tile index (13 bits), flip x (0x2000), flip y (0x4000), transpose (0x8000)
+typedef struct {
+    int tileSize, numTiles, tilemapWidth, tilemapHeight;
+    unsigned short* tilemap;
+} Tileset;
+static __inline unsigned TileHash(const unsigned* tile,int tileArea) {
+    unsigned hash = 2166136261U;int i;   // FNV-1a
+    for (i=0;i<tileArea;i++) hash = (hash^tile[i])*16777619U;
+    return hash;
+}
+// Copies tile (tx,ty) of 'pixels' into 'tileOut' so that: tile(x,y) = tileOut(u,v) (with u,v computed like in ExpandTilemap(...) from 'flags')
+static void ExtractTile(unsigned* tileOut,const unsigned* pixels,int w,int tileSize,int tx,int ty,int flags) {
+    const unsigned* pTile = &pixels[ty*tileSize*w+tx*tileSize];
+    int x,y,u,v,t;
+    for (y=0;y<tileSize;y++,pTile+=w) {
+        for (x=0;x<tileSize;x++) {
+            u = (flags&1) ? tileSize-1-x : x;v = (flags&2) ? tileSize-1-y : y;
+            if (flags&4) {t=u;u=v;v=t;}
+            tileOut[v*tileSize+u] = pTile[x];
+        }
+    }
+}
+// On success the unique tiles replace 'pixels' as a tileSize x (tileSize*numTiles) image. Returns 0 on error.
+static int BuildTileset(Tileset* ts,unsigned* pixels,int* pw,int* ph,int tileSize,int allowFlips) {
+    const int w = *pw, h = *ph, tileArea = tileSize*tileSize, numFlags = allowFlips ? 8 : 1;
+    const int tilemapWidth = w/tileSize, tilemapHeight = h/tileSize, numSlots = 2*TILEMAP_MAX_NUM_TILES;
+    int i,tx,ty,flags,*slots = NULL;unsigned* uniqueTiles = NULL, *hashes = NULL, *candidate = NULL;
+    ts->tileSize = tileSize;ts->numTiles = 0;ts->tilemapWidth = tilemapWidth;ts->tilemapHeight = tilemapHeight;
+    ts->tilemap = (unsigned short*) malloc(tilemapWidth*tilemapHeight*sizeof(unsigned short));
+    slots = (int*) malloc(numSlots*sizeof(int));
+    hashes = (unsigned*) malloc(TILEMAP_MAX_NUM_TILES*sizeof(unsigned));
+    candidate = (unsigned*) malloc(tileArea*sizeof(unsigned));
+    uniqueTiles = (unsigned*) malloc((size_t)w*h*sizeof(unsigned));   // never bigger than the image
+    if (!ts->tilemap || !slots || !hashes || !candidate || !uniqueTiles) {
+        if (ts->tilemap) {free(ts->tilemap);ts->tilemap=NULL;}
+        if (slots) free(slots);
+        if (hashes) free(hashes);
+        if (candidate) free(candidate);
+        if (uniqueTiles) free(uniqueTiles);
+        return 0;
+    }
+    for (i=0;i<numSlots;i++) slots[i]=-1;
+    for (ty=0;ty<tilemapHeight;ty++) {
+        for (tx=0;tx<tilemapWidth;tx++) {
+            int found = -1;unsigned hash = 0;
+            for (flags=0;flags<numFlags && found<0;flags++) {
+                ExtractTile(candidate,pixels,w,tileSize,tx,ty,flags);
+                hash = TileHash(candidate,tileArea);
+                for (i=(int)(hash%(unsigned)numSlots);slots[i]>=0;i=(i+1)%numSlots) {
+                    const int k = slots[i];
+                    if (hashes[k]==hash && memcmp(&uniqueTiles[k*tileArea],candidate,tileArea*sizeof(unsigned))==0) {found = k;break;}
+                }
+            }
+            if (found>=0) {ts->tilemap[ty*tilemapWidth+tx] = (unsigned short) (found|((flags-1)<<13));continue;}
+            if (ts->numTiles==TILEMAP_MAX_NUM_TILES) {
+                free(ts->tilemap);ts->tilemap=NULL;free(slots);free(hashes);free(candidate);free(uniqueTiles);
+                return 0;
+            }
+            ExtractTile(candidate,pixels,w,tileSize,tx,ty,0);
+            hash = TileHash(candidate,tileArea);
+            for (i=(int)(hash%(unsigned)numSlots);slots[i]>=0;i=(i+1)%numSlots) {}
+            slots[i] = ts->numTiles;hashes[ts->numTiles] = hash;
+            memcpy(&uniqueTiles[ts->numTiles*tileArea],candidate,tileArea*sizeof(unsigned));
+            ts->tilemap[ty*tilemapWidth+tx] = (unsigned short) ts->numTiles++;
+        }
     }
+    memcpy(pixels,uniqueTiles,(size_t)ts->numTiles*tileArea*sizeof(unsigned));
+    *pw = tileSize;*ph = tileSize*ts->numTiles;
+    free(slots);free(hashes);free(candidate);free(uniqueTiles);
+    return 1;
+}
 
-    // Write image dimensions
-    fprintf(f,"const int width = %d, height = %d;\n\n",w,h);
 
-    // Write Palette Here
-    numChars = 0;
-    fprintf(f,"/* RGBA palette in little-endian encoding */\n");
-    fprintf(f,"unsigned int palette[%d] = {\n",numPaletteColors);
-    for (j=0;j<numPaletteColors;j++) {
-        PaletteEntry* pe = &palette[j];
-        fprintf(f,"%uU",pe->color);numChars+=pe->color==0?2:11;
-        if (j<numPaletteColors-1) {fprintf(f,",");++numChars;}
-        if (numChars>=numCharsPerLine) {fprintf(f,"\n");numChars=0;}
+// Block compression (--bc1, --bc3 and --etc2): reference encoders for textures that can be uploaded to the GPU as-is
+enum {BLOCK_FORMAT_NONE=0,BLOCK_FORMAT_BC1,BLOCK_FORMAT_BC3,BLOCK_FORMAT_ETC2,BLOCK_FORMAT_ETC2_EAC,BLOCK_FORMAT_COUNT};
+static const int blockFormatSizes[BLOCK_FORMAT_COUNT] = {0,8,16,8,16};
+static const char* blockFormatDescriptions[BLOCK_FORMAT_COUNT] = {"",
+    "BC1 (DXT1) texture. Upload it as GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, DXGI_FORMAT_BC1_UNORM or VK_FORMAT_BC1_RGBA_UNORM_BLOCK",
+    "BC3 (DXT5) texture. Upload it as GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, DXGI_FORMAT_BC3_UNORM or VK_FORMAT_BC3_UNORM_BLOCK",
+    "ETC2 RGB texture. Upload it as GL_COMPRESSED_RGB8_ETC2 or VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK",
+    "ETC2 RGBA texture. Upload it as GL_COMPRESSED_RGBA8_ETC2_EAC or VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK"};
+static const char** blockFormatUsages[BLOCK_FORMAT_COUNT][2] = {{NULL,NULL},{decodeBC1ColorsUsage,decodeBC1Usage},{decodeBC1ColorsUsage,decodeBC3Usage},
+    {decodeETC2ColorBlockUsage,decodeETC2Usage},{decodeETC2ColorBlockUsage,decodeETC2EACUsage}};
+
+// Reads the 4x4 block at (bx,by), replicating the last row and column of the image if needed
+static void ReadBlock(unsigned* block,const unsigned* pixels,int w,int h,int bx,int by) {
+    int x,y;
+    for (y=0;y<4;y++) {
+        const unsigned* row = &pixels[(by+y<h ? by+y : h-1)*w];
+        for (x=0;x<4;x++) block[y*4+x] = row[bx+x<w ? bx+x : w-1];
     }
-    fprintf(f,"};\n\n");
+}
+static __inline int ColorDistance(unsigned a,unsigned b) {
+    const int dr = (int)(a&0xFF)-(int)(b&0xFF), dg = (int)((a>>8)&0xFF)-(int)((b>>8)&0xFF), db = (int)((a>>16)&0xFF)-(int)((b>>16)&0xFF);
+    return dr*dr+dg*dg+db*db;
+}
+static __inline int ClampByte(int v) {return v<0 ? 0 : (v>255 ? 255 : v);}
 
-    // Write indices here
-    numChars = 0;
-    pRaw = (const unsigned int*) raw;
-    if (numPaletteColors>76) {
-        fprintf(f,"/* int indices into palette (%dx%d once uncompressed). Negative values represent further repetitions of the last index */\n",w,h);
-        fprintf(f,"const int indices[] = {\n");
-        for (i=0;i<area;i++) {
-            for (j=0;j<numPaletteColors;j++) {
-                const PaletteEntry* pe = &palette[j];
-                if (pe->color==*pRaw) {
-                    if (lastIdx==j) {++numReps;}
-                    else {
-                        if (numChars>0) {fprintf(f,",");++numChars;}
-                        if (numReps==1) {
-                            // Write 'lastIdx' and 'j'
-                            fprintf(f,"%d",lastIdx);numChars+=lastIdx<10?1:(lastIdx<100?2:(lastIdx<1000?3:lastIdx<10000?4:lastIdx<100000?5:6));
-                            fprintf(f,",");++numChars;
-                            if (numChars>=numCharsPerLine) {fprintf(f,"\n");numChars=0;}
-                        }
-                        else if (numReps>1) {
-                            // Write '-numReps' and 'j'
-                            fprintf(f,"-%lu",numReps);++numChars;numChars+=numReps<10?1:(numReps<100?2:(numReps<1000?3:numReps<10000?4:numReps<100000?5:6));
-                            fprintf(f,",");++numChars;
-                            if (numChars>=numCharsPerLine) {fprintf(f,"\n");numChars=0;}
-                        }
-                        // Write 'j'
-                        fprintf(f,"%d",j);numChars+=j<10?1:(j<100?2:(j<1000?3:j<10000?4:j<100000?5:6));
-                        lastIdx=j;numReps=0;
+// BC1 colors (exactly like DecodeBC1Colors(...) in the .inl file)
+static void GetBC1Colors(unsigned* colors,unsigned c0,unsigned c1,int fourColors) {
+    unsigned char rgb[2][3];int i;
+    rgb[0][0]=(unsigned char)(((c0>>11)<<3)|(c0>>13));rgb[0][1]=(unsigned char)((((c0>>5)&63)<<2)|(((c0>>5)&63)>>4));rgb[0][2]=(unsigned char)(((c0&31)<<3)|((c0&31)>>2));
+    rgb[1][0]=(unsigned char)(((c1>>11)<<3)|(c1>>13));rgb[1][1]=(unsigned char)((((c1>>5)&63)<<2)|(((c1>>5)&63)>>4));rgb[1][2]=(unsigned char)(((c1&31)<<3)|((c1&31)>>2));
+    colors[0]=colors[1]=colors[2]=0xFF000000U;colors[3] = fourColors ? 0xFF000000U : 0;
+    for (i=0;i<3;i++) {
+        colors[0]|=(unsigned)rgb[0][i]<<(8*i);colors[1]|=(unsigned)rgb[1][i]<<(8*i);
+        if (fourColors) {colors[2]|=(unsigned)((2*rgb[0][i]+rgb[1][i])/3)<<(8*i);colors[3]|=(unsigned)((rgb[0][i]+2*rgb[1][i])/3)<<(8*i);}
+        else colors[2]|=(unsigned)((rgb[0][i]+rgb[1][i])/2)<<(8*i);
+    }
+}
+static __inline unsigned ToRGB565(const float* rgb) {
+    const int r = ClampByte((int)(rgb[0]+0.5f)), g = ClampByte((int)(rgb[1]+0.5f)), b = ClampByte((int)(rgb[2]+0.5f));
+    return (unsigned)(((r*31+127)/255)<<11)|(unsigned)(((g*63+127)/255)<<5)|(unsigned)((b*31+127)/255);
+}
+// Writes the endpoints and the indices of (c0,c1) and returns the squared error (transparent pixels use index 3 in the 3-color mode)
+static int WriteBC1ColorBlock(unsigned char* out,const unsigned* block,const int* opaque,unsigned c0,unsigned c1,int fourColors) {
+    unsigned colors[4],bits=0;int k,i,err=0;
+    if (fourColors ? c0<c1 : c0>c1) {const unsigned t=c0;c0=c1;c1=t;}
+    GetBC1Colors(colors,c0,c1,fourColors || c0>c1);
+    for (k=0;k<16;k++) {
+        int best = 3, bestDist = 0x7FFFFFFF;
+        if (opaque[k]) {
+            for (i=0;i<(fourColors ? 4 : 3);i++) {const int d = ColorDistance(block[k],colors[i]);if (d<bestDist) {bestDist=d;best=i;}}
+            err+=bestDist;
+        }
+        bits|=(unsigned)best<<(2*k);
+    }
+    out[0]=(unsigned char)c0;out[1]=(unsigned char)(c0>>8);out[2]=(unsigned char)c1;out[3]=(unsigned char)(c1>>8);
+    out[4]=(unsigned char)bits;out[5]=(unsigned char)(bits>>8);out[6]=(unsigned char)(bits>>16);out[7]=(unsigned char)(bits>>24);
+    return err;
+}
+// Endpoints along the principal axis of the (opaque) colors, or the bounding box diagonal if it is better.
+// With 'fourColors'==0 (BC1 with transparent pixels) the 3-color mode is used.
+static void EncodeBC1ColorBlock(unsigned char* out,const unsigned* block,const int* opaque,int fourColors) {
+    float mean[3]={0,0,0},cov[6]={0,0,0,0,0,0},axis[3]={1,1,1},lo[3],hi[3],c[3],tmin=1e9f,tmax=-1e9f;
+    int k,i,n=0;unsigned char candidate[8];
+    for (i=0;i<3;i++) {lo[i]=255.f;hi[i]=0.f;}
+    for (k=0;k<16;k++) {
+        if (!opaque[k]) continue;
+        for (i=0;i<3;i++) {c[i]=(float)((block[k]>>(8*i))&0xFF);mean[i]+=c[i];if (lo[i]>c[i]) lo[i]=c[i];if (hi[i]<c[i]) hi[i]=c[i];}
+        ++n;
+    }
+    if (n==0) {memset(out,0,4);memset(&out[4],0xFF,4);return;}   // all transparent: c0==c1 (3-color mode) and index 3
+    for (i=0;i<3;i++) mean[i]/=(float)n;
+    for (k=0;k<16;k++) {
+        if (!opaque[k]) continue;
+        for (i=0;i<3;i++) c[i]=(float)((block[k]>>(8*i))&0xFF)-mean[i];
+        cov[0]+=c[0]*c[0];cov[1]+=c[0]*c[1];cov[2]+=c[0]*c[2];cov[3]+=c[1]*c[1];cov[4]+=c[1]*c[2];cov[5]+=c[2]*c[2];
+    }
+    for (i=0;i<8;i++) {     // power iteration
+        const float x = cov[0]*axis[0]+cov[1]*axis[1]+cov[2]*axis[2], y = cov[1]*axis[0]+cov[3]*axis[1]+cov[4]*axis[2], z = cov[2]*axis[0]+cov[4]*axis[1]+cov[5]*axis[2];
+        const float len = (float)sqrt(x*x+y*y+z*z);
+        if (len<1e-6f) break;
+        axis[0]=x/len;axis[1]=y/len;axis[2]=z/len;
+    }
+    for (k=0;k<16;k++) {
+        float t = 0.f;
+        if (!opaque[k]) continue;
+        for (i=0;i<3;i++) t+=((float)((block[k]>>(8*i))&0xFF)-mean[i])*axis[i];
+        if (tmin>t) tmin=t;
+        if (tmax<t) tmax=t;
+    }
+    {
+        float e0[3],e1[3];int err,bestErr;
+        for (i=0;i<3;i++) {e0[i]=mean[i]+axis[i]*tmax;e1[i]=mean[i]+axis[i]*tmin;}
+        bestErr = WriteBC1ColorBlock(out,block,opaque,ToRGB565(e0),ToRGB565(e1),fourColors);
+        if (bestErr>0) {
+            err = WriteBC1ColorBlock(candidate,block,opaque,ToRGB565(hi),ToRGB565(lo),fourColors);
+            if (err<bestErr) memcpy(out,candidate,8);
+        }
+    }
+}
+// BC3 alpha block: the 8-alpha mode between min and max, or the 6-alpha mode (with 0 and 255) if it is better
+static int WriteBC3AlphaBlock(unsigned char* out,const unsigned* block,int a0,int a1) {
+    int alphas[8],k,i,err=0;unsigned bits[2]={0,0};
+    alphas[0]=a0;alphas[1]=a1;
+    if (a0>a1) {for (k=2;k<8;k++) alphas[k] = ((8-k)*a0+(k-1)*a1)/7;}
+    else {for (k=2;k<6;k++) alphas[k] = ((6-k)*a0+(k-1)*a1)/5;alphas[6]=0;alphas[7]=255;}
+    for (k=0;k<16;k++) {
+        const int a = (int)(block[k]>>24);int best=0,bestDist=0x7FFFFFFF;
+        for (i=0;i<8;i++) {const int d = (a-alphas[i])*(a-alphas[i]);if (d<bestDist) {bestDist=d;best=i;}}
+        err+=bestDist;bits[k/8]|=(unsigned)best<<(3*(k%8));
+    }
+    out[0]=(unsigned char)a0;out[1]=(unsigned char)a1;
+    for (i=0;i<2;i++) {out[2+3*i]=(unsigned char)bits[i];out[3+3*i]=(unsigned char)(bits[i]>>8);out[4+3*i]=(unsigned char)(bits[i]>>16);}
+    return err;
+}
+static void EncodeBC3AlphaBlock(unsigned char* out,const unsigned* block) {
+    int k,err,minA=255,maxA=0,minA6=255,maxA6=0;unsigned char candidate[8];
+    for (k=0;k<16;k++) {
+        const int a = (int)(block[k]>>24);
+        if (minA>a) minA=a;
+        if (maxA<a) maxA=a;
+        if (a!=0 && a!=255) {if (minA6>a) minA6=a;if (maxA6<a) maxA6=a;}
+    }
+    if (minA6>maxA6) minA6=maxA6=minA;
+    err = WriteBC3AlphaBlock(out,block,maxA,minA);
+    if (err>0 && WriteBC3AlphaBlock(candidate,block,minA6,maxA6)<err) memcpy(out,candidate,8);
+}
+
+// ETC2 color block in the ETC1-compatible individual (4-bit colors) or differential (5-bit colors and 3-bit deltas) mode
+static const int etc1Modifiers[8][2] = {{2,8},{5,17},{9,29},{13,42},{18,60},{24,80},{33,106},{47,183}};
+// Returns the squared error of the best table for the pixels of a sub-block (pixel k is (k/4,k%4) in the block: column-major order)
+static int FitETC1SubBlock(const unsigned* block,int flip,int sub,const int* base,int* pTable,unsigned* pBits) {
+    int t,k,i,j,bestErr=0x7FFFFFFF;
+    for (t=0;t<8;t++) {
+        int err=0;unsigned bits=0;
+        for (k=0;k<16;k++) {
+            const int x=k/4,y=k%4;int bestJ=0,bestD=0x7FFFFFFF;
+            if ((flip ? y>=2 : x>=2)!=sub) continue;
+            for (j=0;j<4;j++) {
+                const int m = j&2 ? -etc1Modifiers[t][j&1] : etc1Modifiers[t][j&1];int d=0;
+                for (i=0;i<3;i++) {const int e = ClampByte(base[i]+m)-(int)((block[y*4+x]>>(8*i))&0xFF);d+=e*e;}
+                if (d<bestD) {bestD=d;bestJ=j;}
+            }
+            err+=bestD;bits|=((unsigned)(bestJ&1)<<k)|((unsigned)(bestJ>>1)<<(16+k));
+        }
+        if (err<bestErr) {bestErr=err;*pTable=t;*pBits=bits;}
+    }
+    return bestErr;
+}
+static void EncodeETC2ColorBlock(unsigned char* out,const unsigned* block) {
+    int flip,diff,sub,k,i,bestErr=0x7FFFFFFF;
+    for (flip=0;flip<2;flip++) {
+        float avg[2][3]={{0,0,0},{0,0,0}};
+        for (k=0;k<16;k++) {
+            const int x=k%4,y=k/4;sub = flip ? y>=2 : x>=2;
+            for (i=0;i<3;i++) avg[sub][i]+=(float)((block[k]>>(8*i))&0xFF)/8.f;
+        }
+        for (diff=0;diff<2;diff++) {
+            int q[2][3],base[2][3],table[2],err;unsigned bits[2];unsigned char candidate[8];
+            for (sub=0;sub<2;sub++) {
+                for (i=0;i<3;i++) {
+                    const int maxQ = diff ? 31 : 15;
+                    q[sub][i] = (int)(avg[sub][i]*(float)maxQ/255.f+0.5f);
+                    if (diff && sub==1) {   // the second color is a delta in [-4,3]
+                        if (q[1][i]<q[0][i]-4) q[1][i]=q[0][i]-4;
+                        if (q[1][i]>q[0][i]+3) q[1][i]=q[0][i]+3;
                     }
-                    break;
+                    base[sub][i] = diff ? (q[sub][i]<<3)|(q[sub][i]>>2) : (q[sub][i]<<4)|q[sub][i];
                 }
             }
-            if (numChars>=numCharsPerLine) {
-                if (i<area-1) fprintf(f,",");
-                fprintf(f,"\n");numChars=0;
+            err = FitETC1SubBlock(block,flip,0,base[0],&table[0],&bits[0])+FitETC1SubBlock(block,flip,1,base[1],&table[1],&bits[1]);
+            if (err>=bestErr) continue;
+            bestErr = err;bits[0]|=bits[1];
+            for (i=0;i<3;i++) candidate[i] = (unsigned char) (diff ? (q[0][i]<<3)|((q[1][i]-q[0][i])&7) : (q[0][i]<<4)|q[1][i]);
+            candidate[3] = (unsigned char) ((table[0]<<5)|(table[1]<<2)|(diff<<1)|flip);
+            candidate[4]=(unsigned char)(bits[0]>>24);candidate[5]=(unsigned char)(bits[0]>>16);candidate[6]=(unsigned char)(bits[0]>>8);candidate[7]=(unsigned char)bits[0];
+            memcpy(out,candidate,8);
+        }
+    }
+}
+// ETC2 EAC alpha block (brute force search of the table, the multiplier and the base alpha)
+static const signed char eacModifiers[16][8] = {{-3,-6,-9,-15,2,5,8,14},{-3,-7,-10,-13,2,6,9,12},{-2,-5,-8,-13,1,4,7,12},{-2,-4,-6,-13,1,3,5,12},
+                                                {-3,-6,-8,-12,2,5,7,11},{-3,-7,-9,-11,2,6,8,10},{-4,-7,-8,-11,3,6,7,10},{-3,-5,-8,-11,2,4,7,10},
+                                                {-2,-6,-8,-10,1,5,7,9},{-2,-5,-8,-10,1,4,7,9},{-2,-4,-8,-10,1,3,7,9},{-2,-5,-7,-10,1,4,6,9},
+                                                {-3,-4,-7,-10,2,3,6,9},{-1,-2,-3,-10,0,1,2,9},{-4,-6,-8,-9,3,5,7,8},{-3,-5,-7,-9,2,4,6,8}};
+static void EncodeEACAlphaBlock(unsigned char* out,const unsigned* block) {
+    int k,t,m,j,minA=255,maxA=0,bestErr=0x7FFFFFFF,bestBase=0,bestT=13,bestM=1;unsigned bits[2]={0,0};
+    for (k=0;k<16;k++) {const int a = (int)(block[k]>>24);if (minA>a) minA=a;if (maxA<a) maxA=a;}
+    if (minA==maxA) {bestBase=minA;bestErr=0;}     // table 13 has a zero modifier
+    for (t=0;t<16 && bestErr>0;t++) {
+        const int lo = eacModifiers[t][3], hi = eacModifiers[t][7];
+        for (m=1;m<16 && bestErr>0;m++) {
+            const int base = ClampByte((minA+maxA-(lo+hi)*m+1)/2);int err=0;
+            for (k=0;k<16 && err<bestErr;k++) {
+                const int a = (int)(block[(k%4)*4+k/4]>>24);int bestD=0x7FFFFFFF;
+                for (j=0;j<8;j++) {const int d = ClampByte(base+eacModifiers[t][j]*m)-a;if (d*d<bestD) bestD=d*d;}
+                err+=bestD;
             }
-            ++pRaw;
+            if (err<bestErr) {bestErr=err;bestBase=base;bestT=t;bestM=m;}
         }
-        fprintf(f,"};\n\n");
+    }
+    for (k=0;k<16;k++) {
+        const int a = (int)(block[(k%4)*4+k/4]>>24);int bestJ=0,bestD=0x7FFFFFFF;
+        for (j=0;j<8;j++) {const int d = ClampByte(bestBase+eacModifiers[bestT][j]*bestM)-a;if (d*d<bestD) {bestD=d*d;bestJ=j;}}
+        bits[k/8]|=(unsigned)bestJ<<(21-3*(k%8));
+    }
+    out[0]=(unsigned char)bestBase;out[1]=(unsigned char)((bestM<<4)|bestT);
+    for (k=0;k<2;k++) {out[2+3*k]=(unsigned char)(bits[k]>>16);out[3+3*k]=(unsigned char)(bits[k]>>8);out[4+3*k]=(unsigned char)bits[k];}
+}
 
-#       ifndef NO_USAGE_IN_INL_FILES
-        fprintf(f,"#ifdef USAGE\n%s\n#endif //USAGE\n\n",*decodeImageIntUsage);
-#       endif
+typedef struct {
+    const unsigned* pixels;
+    unsigned char* blocks;
+    int w,h,format;
+} BlockJobData;
+static void BlockCompressJob(void* userData,int jobIndex) {     // one row of blocks
+    BlockJobData* d = (BlockJobData*) userData;
+    const int numBlocksX = (d->w+3)/4, blockSize = blockFormatSizes[d->format];
+    unsigned block[16];int bx,k,opaque[16];
+    unsigned char* out = &d->blocks[(size_t)jobIndex*numBlocksX*blockSize];
+    for (bx=0;bx<numBlocksX;bx++,out+=blockSize) {
+        ReadBlock(block,d->pixels,d->w,d->h,bx*4,jobIndex*4);
+        for (k=0;k<16;k++) opaque[k] = d->format!=BLOCK_FORMAT_BC1 || (block[k]>>24)>=128;
+        if (d->format==BLOCK_FORMAT_BC1) {
+            for (k=0;k<16 && opaque[k];k++) {}
+            EncodeBC1ColorBlock(out,block,opaque,k==16);
+        }
+        else if (d->format==BLOCK_FORMAT_BC3) {EncodeBC3AlphaBlock(out,block);EncodeBC1ColorBlock(&out[8],block,opaque,1);}
+        else if (d->format==BLOCK_FORMAT_ETC2) EncodeETC2ColorBlock(out,block);
+        else {EncodeEACAlphaBlock(out,block);EncodeETC2ColorBlock(&out[8],block);}
     }
-    else {
-        char minChar = 'b',maxChar='a';
-        fprintf(f,"/* Each entry when uncompressed to %d*%d represents an index into the palette array */\n",w,h);
-        fprintf(f,"const char* indices[] = {\n");
-        for (i=0;i<area;i++) {
-            for (j=0;j<numPaletteColors;j++) {
-                const PaletteEntry* pe = &palette[j];
-                if (pe->color==*pRaw) {
-
-                    curChar = (char)(j+(int)'0');
-                    if (curChar>='\\') curChar = (char) ((int)curChar+1);
-
-                    if (minChar>curChar) minChar=curChar;
-                    if (maxChar<curChar) maxChar=curChar;
-                    ASSERT(curChar!='\\');
-
-                    if (lastChar==curChar && numReps<76) {++numReps;}
-                    else {
-                        if (numChars==0) {fprintf(f,"\"");++numChars;}
-                        else if (numReps==0 &&
-                                 ((lastChar=='?' && curChar=='?') || (lastChar=='<' && curChar==':') || (lastChar==':' && curChar=='>'))
-                                 ) {fprintf(f,"\"\"");++numChars;++numChars;}   // Trigraphs removal
-                        if (numReps==1) {
-                            // Write 'lastChar' (again)
-                            if (lastChar=='?') {fprintf(f,"\"\"");++numChars;++numChars;}   // Trigraphs removal
-                            fprintf(f,"%c",lastChar);++numChars;
-                            if (numChars>=numCharsPerLine) {fprintf(f,"\"\n\"");numChars=1;}
-                            if ((lastChar=='?' && curChar=='?') || (lastChar=='<' && curChar==':') || (lastChar==':' && curChar=='>'))
-                                {fprintf(f,"\"\"");++numChars;++numChars;}   // Trigraphs removal
-                        }
-                        else if (numReps>1) {
-                            // Write '~' + numReps
-                            char numRepsChar = (char)((int)numReps+(int)'0');
-                            if (numRepsChar>='\\') numRepsChar = (char) ((int)numRepsChar+1);
-                            ASSERT(numRepsChar!='\\' && numRepsChar>='0' && numRepsChar<'~');
-                            fprintf(f,"~%c",numRepsChar);++numChars;++numChars;
-                            if (numChars>=numCharsPerLine) {fprintf(f,"\"\n\"");numChars=1;}
-                            if ((numRepsChar=='?' && curChar=='?') || (numRepsChar=='<' && curChar==':') || (numRepsChar==':' && curChar=='>'))
-                                {fprintf(f,"\"\"");++numChars;++numChars;}   // Trigraphs removal
-                        }
-                        // Write 'curChar'
-                        fprintf(f,"%c",curChar);++numChars;
-                        lastChar=curChar;numReps=0;
-                    }
-                    break;
-                }
-            }
-            if (numChars>=numCharsPerLine) {fprintf(f,"\"\n");numChars=0;}
-            ++pRaw;
+}
+// Returns a malloc'ed array of ((w+3)/4)*((h+3)/4) blocks (or NULL)
+static unsigned char* CompressBlocks(const unsigned* pixels,int w,int h,int format,int numThreads) {
+    BlockJobData d;
+    d.blocks = (unsigned char*) malloc((size_t)((w+3)/4)*((h+3)/4)*blockFormatSizes[format]);
+    if (d.blocks) {
+        d.pixels=pixels;d.w=w;d.h=h;d.format=format;
+        ParallelFor((h+3)/4,&BlockCompressJob,&d,numThreads);
+    }
+    return d.blocks;
+}
+
+
+// Open-addressing hash table of PaletteEntry (an entry with reps==0 is an empty slot)
+typedef struct {
+    PaletteEntry* entries;
+    int log2Capacity,numEntries,maxNumEntries;
+} PaletteHash;
+static int PaletteHashInit(PaletteHash* ph,int maxNumEntries) {
+    ph->log2Capacity=4;while ((1<<ph->log2Capacity)<2*maxNumEntries) ++ph->log2Capacity;
+    ph->numEntries=0;ph->maxNumEntries=maxNumEntries;
+    ph->entries = (PaletteEntry*) calloc((size_t)1<<ph->log2Capacity,sizeof(PaletteEntry));
+    return ph->entries!=NULL;
+}
+static void PaletteHashFree(PaletteHash* ph) {if (ph->entries) {free(ph->entries);ph->entries=NULL;} ph->numEntries=0;}
+// Returns the slot of 'color', or -1 if not present
+static __inline int PaletteHashFind(const PaletteHash* ph,unsigned color) {
+    const unsigned mask = (1U<<ph->log2Capacity)-1U;
+    unsigned slot = (color*2654435761U)>>(32-ph->log2Capacity);
+    for (;;slot=(slot+1)&mask) {
+        const PaletteEntry* pe = &ph->entries[slot];
+        if (pe->reps==0) return -1;
+        if (pe->color==color) return (int)slot;
+    }
+}
+// Returns the slot of 'color' (added if not present), or NULL if the table already has 'maxNumEntries' colors
+static __inline PaletteEntry* PaletteHashAdd(PaletteHash* ph,unsigned color,unsigned long reps,unsigned long firstIndex) {
+    const unsigned mask = (1U<<ph->log2Capacity)-1U;
+    unsigned slot = (color*2654435761U)>>(32-ph->log2Capacity);
+    for (;;slot=(slot+1)&mask) {
+        PaletteEntry* pe = &ph->entries[slot];
+        if (pe->reps==0) {
+            if (ph->numEntries>=ph->maxNumEntries) return NULL;
+            ++ph->numEntries;pe->color=color;pe->reps=reps;pe->firstIndex=firstIndex;
+            return pe;
+        }
+        if (pe->color==color) {
+            pe->reps+=reps;if (pe->firstIndex>firstIndex) pe->firstIndex=firstIndex;
+            return pe;
+        }
+    }
+}
+
+
+// Histogram: every job builds a partial PaletteHash from a contiguous chunk of pixels, then we merge them.
+// The merged result (and so the sorted palette) does not depend on the number of threads.
+typedef struct {
+    const unsigned* pixels;
+    int area,numJobs;
+    PaletteHash* partials;
+    int* overflow;
+} HistogramJobData;
+static void HistogramJob(void* userData,int jobIndex) {
+    HistogramJobData* d = (HistogramJobData*) userData;
+    PaletteHash* ph = &d->partials[jobIndex];
+    const int start = (int)(((long long)d->area*jobIndex)/d->numJobs);
+    const int end = (int)(((long long)d->area*(jobIndex+1))/d->numJobs);
+    PaletteEntry* last = NULL;
+    int i;
+    for (i=start;i<end;i++) {
+        const unsigned color = d->pixels[i];
+        if (last && last->color==color) {++last->reps;continue;}
+        last = PaletteHashAdd(ph,color,1,(unsigned long)i);
+        if (!last) {d->overflow[jobIndex]=1;return;}
+    }
+}
+#define MAX_NUM_PALETTE_COLORS  (498)   // the limit of all the modes but --v2 (CHARS_V2_MAX_COLORS)
+
+// Fills palette[] (sorted by PaletteEntryCmp) and returns the number of colors, or -1 if there are more than maxNumPaletteColors
+static int BuildSortedPalette(PaletteEntry* palette,int maxNumPaletteColors,const unsigned* pixels,int area,int numThreads) {
+    HistogramJobData d;PaletteHash merged;
+    int i,j,numColors=-1,numJobs = numThreads,span = -1;
+    if (numJobs<1) numJobs=1;
+    if (numJobs>area/4096+1) numJobs=area/4096+1;   // tiny images are not worth splitting
+    d.pixels=pixels;d.area=area;d.numJobs=numJobs;
+    d.partials = (PaletteHash*) calloc(numJobs,sizeof(PaletteHash));
+    d.overflow = (int*) calloc(numJobs,sizeof(int));
+    merged.entries = NULL;
+    if (!d.partials || !d.overflow) goto cleanup;
+    for (i=0;i<numJobs;i++) if (!PaletteHashInit(&d.partials[i],maxNumPaletteColors)) goto cleanup;
+    if (!PaletteHashInit(&merged,maxNumPaletteColors)) goto cleanup;
+
+    span = TraceBegin("histogram");
+    ParallelFor(numJobs,&HistogramJob,&d,numThreads);
+
+    for (i=0;i<numJobs;i++) {
+        const PaletteHash* ph = &d.partials[i];
+        if (d.overflow[i]) goto cleanup;
+        for (j=0;j<(1<<ph->log2Capacity);j++) {
+            const PaletteEntry* pe = &ph->entries[j];
+            if (pe->reps>0 && !PaletteHashAdd(&merged,pe->color,pe->reps,pe->firstIndex)) goto cleanup;
         }
-        fprintf(f,"\"};\n\n");
+    }
+    numColors = 0;
+    for (j=0;j<(1<<merged.log2Capacity);j++) {
+        if (merged.entries[j].reps>0) palette[numColors++]=merged.entries[j];
+    }
+    TraceEnd(span);
+    span = TraceBegin("sort");
+    qsort(&palette[0],numColors,sizeof(PaletteEntry),&PaletteEntryCmp);
+    TraceEnd(span);
 
-#       ifndef NO_USAGE_IN_INL_FILES
-        fprintf(f,"#ifdef USAGE\n%s\n#endif //USAGE\n\n",*decodeImageUsage);
-#       endif
+cleanup:
+    if (numColors<0) TraceEnd(span);
+    PaletteHashFree(&merged);
+    if (d.partials) {for (i=0;i<numJobs;i++) PaletteHashFree(&d.partials[i]);free(d.partials);}
+    if (d.overflow) free(d.overflow);
+    return numColors;
+}
+
+
+// Remaps every pixel to its palette index (through a PaletteHash that stores the index in 'firstIndex')
+typedef struct {
+    const unsigned* pixels;
+    unsigned short* indices;
+    int area,numJobs;
+    const PaletteHash* lookup;
+} RemapJobData;
+static void RemapJob(void* userData,int jobIndex) {
+    RemapJobData* d = (RemapJobData*) userData;
+    const int start = (int)(((long long)d->area*jobIndex)/d->numJobs);
+    const int end = (int)(((long long)d->area*(jobIndex+1))/d->numJobs);
+    unsigned lastColor = 0;unsigned short lastIndex = 0;
+    int i,slot;
+    if (start<end) {lastColor=d->pixels[start];slot=PaletteHashFind(d->lookup,lastColor);ASSERT(slot>=0);lastIndex=(unsigned short)d->lookup->entries[slot].firstIndex;}
+    for (i=start;i<end;i++) {
+        const unsigned color = d->pixels[i];
+        if (color!=lastColor) {
+            slot = PaletteHashFind(d->lookup,color);ASSERT(slot>=0);
+            lastColor = color;lastIndex = (unsigned short) d->lookup->entries[slot].firstIndex;
+        }
+        d->indices[i] = lastIndex;
+    }
+}
+// Returns a malloc'ed area-sized array of palette indices (or NULL)
+static unsigned short* RemapToPaletteIndices(const PaletteEntry* palette,int numPaletteColors,const unsigned* pixels,int area,int numThreads) {
+    RemapJobData d;PaletteHash lookup;int j,numJobs = numThreads;
+    if (!PaletteHashInit(&lookup,numPaletteColors)) return NULL;
+    for (j=0;j<numPaletteColors;j++) PaletteHashAdd(&lookup,palette[j].color,1,(unsigned long)j);
+    d.indices = (unsigned short*) malloc(area*sizeof(unsigned short));
+    if (d.indices) {
+        if (numJobs<1) numJobs=1;
+        if (numJobs>area/4096+1) numJobs=area/4096+1;
+        d.pixels=pixels;d.area=area;d.numJobs=numJobs;d.lookup=&lookup;
+        ParallelFor(numJobs,&RemapJob,&d,numThreads);
     }
+    PaletteHashFree(&lookup);
+    return d.indices;
+}
 
-    fclose(f);f=NULL;
 
-    if (raw) {STBI_FREE(raw);raw=NULL;}
-    //printf("\"%s\" -> \"%s\"OK\n",filename,savename);
-    return 0;
+// Paletted PNGs (color type 3, e.g. from pngnq) are read directly: PLTE/tRNS and the index plane (inflated with stb_image's zlib),
+// so that the RGBA expansion, the color histogram and the color lookups are skipped. Interlaced or unusual files return 0 (use stbi_load).
+typedef struct {
+    int w,h,numColors;
+    unsigned colors[256];           // PLTE + tRNS (same byte order as the RGBA path)
+    unsigned char* indices;         // w*h PLTE indices (malloc'ed)
+    unsigned short remap[256];      // PLTE index -> sorted palette index (see BuildPaletteFromIndices(...))
+} PalettedImage;
+static __inline unsigned ReadBigEndian32(const unsigned char* p) {return ((unsigned)p[0]<<24)|((unsigned)p[1]<<16)|((unsigned)p[2]<<8)|(unsigned)p[3];}
+static int LoadPalettedPng(PalettedImage* img,const unsigned char* data,size_t size,int flipY) {
+    static const unsigned char signature[8] = {137,80,78,71,13,10,26,10};
+    const unsigned char *p = data+8, *end = data+size;
+    unsigned char *idat = NULL, *inflated = NULL, *prior, *row;
+    size_t idatSize = 0, rowBytes = 0, x;
+    int y,k,depth = 0,inflatedSize = 0,ok = 0;
+    unsigned char rgba[4][256];
+    memset(img,0,sizeof(*img));memset(rgba,0,sizeof(rgba));memset(rgba[3],255,256);
+    if (size<8 || memcmp(data,signature,8)!=0) return 0;
+    // Chunks (the IDAT data is concatenated)
+    while (end-p>=12) {
+        const unsigned len = ReadBigEndian32(p);
+        const unsigned char* chunk = p+8;
+        if ((size_t)(end-chunk)<(size_t)len+4) goto cleanup;
+        if (memcmp(p+4,"IHDR",4)==0) {
+            if (len<13) goto cleanup;
+            img->w = (int) ReadBigEndian32(chunk);img->h = (int) ReadBigEndian32(chunk+4);depth = chunk[8];
+            if (chunk[9]!=3 || chunk[12]!=0 || (depth!=1 && depth!=2 && depth!=4 && depth!=8)) goto cleanup;  // not paletted, or interlaced
+            if (img->w<=0 || img->h<=0 || img->w>(1<<24) || img->h>(1<<24) || (double)img->w*img->h>(double)(1<<30)) goto cleanup;
+        }
+        else if (memcmp(p+4,"PLTE",4)==0) {
+            img->numColors = (int) (len/3);
+            if (img->numColors>256) goto cleanup;
+            for (k=0;k<img->numColors;k++) {rgba[0][k]=chunk[k*3];rgba[1][k]=chunk[k*3+1];rgba[2][k]=chunk[k*3+2];}
+        }
+        else if (memcmp(p+4,"tRNS",4)==0) {
+            for (k=0;k<(int)len && k<256;k++) rgba[3][k]=chunk[k];
+        }
+        else if (memcmp(p+4,"IDAT",4)==0) {
+            unsigned char* newIdat = (unsigned char*) realloc(idat,idatSize+len);
+            if (!newIdat) goto cleanup;
+            idat = newIdat;memcpy(&idat[idatSize],chunk,len);idatSize+=len;
+        }
+        else if (memcmp(p+4,"IEND",4)==0) break;
+        p = chunk+len+4;
+    }
+    if (depth==0 || img->numColors==0 || !idat) goto cleanup;
+    for (k=0;k<256;k++) {const unsigned char c[4] = {rgba[0][k],rgba[1][k],rgba[2][k],rgba[3][k]};memcpy(&img->colors[k],c,4);}
+
+    // Inflate and unfilter (filters work on whole bytes here, since pixels have 8 bits or less)
+    rowBytes = ((size_t)img->w*depth+7)/8;
+    inflated = (unsigned char*) stbi_zlib_decode_malloc_guesssize_headerflag((const char*)idat,(int)idatSize,(int)((rowBytes+1)*img->h),&inflatedSize,1);
+    if (!inflated || (size_t)inflatedSize<(rowBytes+1)*img->h) goto cleanup;
+    img->indices = (unsigned char*) malloc((size_t)img->w*img->h);
+    if (!img->indices) goto cleanup;
+    for (y=0,prior=NULL;y<img->h;y++,prior=row) {
+        const int filter = inflated[y*(rowBytes+1)];
+        unsigned char* out = &img->indices[(size_t)(flipY ? img->h-1-y : y)*img->w];
+        row = &inflated[y*(rowBytes+1)+1];
+        for (x=0;x<rowBytes;x++) {
+            const int a = x>0 ? row[x-1] : 0, b = prior ? prior[x] : 0, c = (prior && x>0) ? prior[x-1] : 0;
+            int pred = 0;
+            switch (filter) {
+            case 0: break;
+            case 1: pred = a;break;
+            case 2: pred = b;break;
+            case 3: pred = (a+b)>>1;break;
+            case 4: {const int pa = abs(b-c), pb = abs(a-c), pc = abs(a+b-2*c);pred = (pa<=pb && pa<=pc) ? a : (pb<=pc ? b : c);} break;
+            default: goto cleanup;
+            }
+            row[x] = (unsigned char) (row[x]+pred);
+        }
+        // Unpack the indices
+        if (depth==8) memcpy(out,row,img->w);
+        else {
+            const int perByte = 8/depth, mask = (1<<depth)-1;
+            for (x=0;x<(size_t)img->w;x++) out[x] = (unsigned char) ((row[x/perByte]>>(8-depth*(int)(x%perByte+1)))&mask);
+        }
+        for (x=0;x<(size_t)img->w;x++) {if (out[x]>=img->numColors) goto cleanup;}
+    }
+    ok = 1;
+
+cleanup:
+    if (idat) free(idat);
+    if (inflated) STBI_FREE(inflated);
+    if (!ok && img->indices) {free(img->indices);img->indices=NULL;}
+    return ok;
+}
+// Counts the PLTE indices, merges duplicate PLTE colors and fills palette[] (sorted by PaletteEntryCmp, like BuildSortedPalette(...))
+// and img->remap. Returns the number of colors.
+static int BuildPaletteFromIndices(PaletteEntry* palette,PalettedImage* img) {
+    unsigned long counts[256],firstIndex[256];
+    int i,j,numColors=0,area=img->w*img->h;
+    memset(counts,0,sizeof(counts));
+    for (i=area-1;i>=0;i--) {const int k = img->indices[i];++counts[k];firstIndex[k]=(unsigned long)i;}
+    for (i=0;i<256;i++) {
+        if (counts[i]==0) continue;
+        for (j=0;j<numColors && palette[j].color!=img->colors[i];j++) {}
+        if (j==numColors) {palette[j].color=img->colors[i];palette[j].reps=0;palette[j].firstIndex=firstIndex[i];++numColors;}
+        palette[j].reps+=counts[i];
+        if (firstIndex[i]<palette[j].firstIndex) palette[j].firstIndex=firstIndex[i];
+    }
+    qsort(&palette[0],numColors,sizeof(PaletteEntry),&PaletteEntryCmp);
+    for (i=0;i<256;i++) {
+        if (counts[i]==0) continue;
+        for (j=0;palette[j].color!=img->colors[i];j++) {}
+        img->remap[i] = (unsigned short) j;
+    }
+    return numColors;
+}
+// Returns a malloc'ed area-sized array of palette indices (or NULL)
+static unsigned short* RemapPalettedIndices(const PalettedImage* img) {
+    const int area = img->w*img->h;
+    unsigned short* indices = (unsigned short*) malloc(area*sizeof(unsigned short));
+    int i;
+    if (indices) {for (i=0;i<area;i++) indices[i] = img->remap[img->indices[i]];}
+    return indices;
+}
+
+
+// --variant: fills 'variantColors' (numPaletteColors+1 entries) with the color that every palette index has in a variant image of the
+// same size. Returns 0 if the variant does not have the same index structure (one palette index with two colors) and sets '*pMismatch'
+// to the first pixel that breaks it (-1 if out of memory). Unused indices keep the base colors.
+#ifndef MAX_NUM_PALETTE_VARIANTS
+#   define MAX_NUM_PALETTE_VARIANTS (32)
+#endif
+static int MatchPaletteVariant(unsigned* variantColors,const PaletteEntry* palette,int numPaletteColors,const unsigned short* pIndices,const unsigned* pixels,int area,int* pMismatch) {
+    unsigned char* seen = (unsigned char*) calloc(numPaletteColors+1,1);
+    int i,j;
+    *pMismatch = -1;
+    if (!seen) return 0;
+    for (i=0;i<area;i++) {
+        j = pIndices[i];
+        if (!seen[j]) {seen[j]=1;variantColors[j]=pixels[i];}
+        else if (variantColors[j]!=pixels[i]) {*pMismatch=i;free(seen);return 0;}
+    }
+    for (j=0;j<numPaletteColors;j++) {if (!seen[j]) variantColors[j]=palette[j].color;}
+    variantColors[numPaletteColors] = variantColors[0];     // (1bpp with a single color)
+    free(seen);
+    return 1;
+}
+
+
+// --progressive: returns a malloc'ed copy of 'pIndices' in the order of the 7 passes of Adam7 interlacing (or NULL)
+static unsigned short* ReorderToProgressive(const unsigned short* pIndices,int w,int h) {
+    static const int passes[7][4] = {{0,0,8,8},{4,0,8,8},{0,4,4,8},{2,0,4,4},{0,2,2,4},{1,0,2,2},{0,1,1,2}};    // x0,y0,dx,dy
+    unsigned short* out = (unsigned short*) malloc((size_t)w*h*sizeof(unsigned short));
+    int p,x,y,n=0;
+    if (!out) return NULL;
+    for (p=0;p<7;p++) {
+        for (y=passes[p][1];y<h;y+=passes[p][3]) {
+            for (x=passes[p][0];x<w;x+=passes[p][2]) out[n++] = pIndices[y*w+x];
+        }
+    }
+    return out;
+}
+
+// --scan: the order in which the pixels are encoded (the decoders write them in this order, then UnscanImage(...) puts them back in rows)
+enum {SCAN_ORDER_ROW=0,SCAN_ORDER_COLUMN,SCAN_ORDER_SERPENTINE,SCAN_ORDER_HILBERT,SCAN_ORDER_COUNT};
+static const char* scanOrderNames[SCAN_ORDER_COUNT] = {"row","column","serpentine","hilbert"};
+static const char* scanOrderDescriptions[SCAN_ORDER_COUNT] = {"row-major","column-major","serpentine (odd rows go from right to left)","Hilbert curves in 16x16 tiles"};
+static const char** unscanUsages[SCAN_ORDER_COUNT] = {NULL,unscanColumnUsage,unscanSerpentineUsage,unscanHilbertUsage};
+// Fills 'curve' with the (x,y) positions of a Hilbert curve through a 16x16 tile (the same as the one in unscanHilbertUsage)
+static void BuildHilbertTileCurve(unsigned char curve[256][2]) {
+    int d,s,t,rx,ry,tmp,x,y;
+    for (d=0;d<256;d++) {
+        for (s=1,t=d,x=y=0;s<16;s*=2,t/=4) {
+            rx = 1&(t/2);ry = 1&(t^rx);
+            if (ry==0) {if (rx==1) {x=s-1-x;y=s-1-y;} tmp=x;x=y;y=tmp;}
+            x+=s*rx;y+=s*ry;
+        }
+        curve[d][0]=(unsigned char)x;curve[d][1]=(unsigned char)y;
+    }
+}
+// Returns a malloc'ed copy of 'pIndices' in 'scanOrder' (or NULL)
+static unsigned short* ReorderToScanOrder(const unsigned short* pIndices,int w,int h,int scanOrder) {
+    unsigned short* out = (unsigned short*) malloc((size_t)w*h*sizeof(unsigned short));
+    unsigned char curve[256][2];
+    int x,y,d,tx,ty,n=0;
+    if (!out) return NULL;
+    switch (scanOrder) {
+    case SCAN_ORDER_COLUMN: for (x=0;x<w;x++) {for (y=0;y<h;y++) out[n++] = pIndices[y*w+x];} break;
+    case SCAN_ORDER_SERPENTINE:
+        for (y=0;y<h;y++) {
+            if (y&1) {for (x=w-1;x>=0;x--) out[n++] = pIndices[y*w+x];}
+            else {for (x=0;x<w;x++) out[n++] = pIndices[y*w+x];}
+        }
+    break;
+    case SCAN_ORDER_HILBERT:
+        BuildHilbertTileCurve(curve);
+        for (ty=0;ty<h;ty+=16) {
+            for (tx=0;tx<w;tx+=16) {
+                for (d=0;d<256;d++) {
+                    x = tx+curve[d][0];y = ty+curve[d][1];
+                    if (x<w && y<h) out[n++] = pIndices[y*w+x];
+                }
+            }
+        }
+    break;
+    default: memcpy(out,pIndices,(size_t)w*h*sizeof(unsigned short));n=w*h;break;
+    }
+    ASSERT(n==w*h);
+    return out;
+}
+
+
+// Growable output buffer (so that parts of the .inl file can be generated concurrently)
+typedef struct {
+    char* data;
+    size_t size,capacity;
+    int failed;
+} OutBuffer;
+static void OutBufferFree(OutBuffer* ob) {if (ob->data) {free(ob->data);} ob->data=NULL;ob->size=ob->capacity=0;}
+static int OutBufferReserve(OutBuffer* ob,size_t extraSize) {
+    if (ob->size+extraSize>ob->capacity) {
+        size_t newCapacity = ob->capacity<256 ? 256 : ob->capacity*2;
+        char* newData;
+        while (newCapacity<ob->size+extraSize) newCapacity*=2;
+        newData = (char*) realloc(ob->data,newCapacity);
+        if (!newData) {ob->failed=1;return 0;}
+        ob->data=newData;ob->capacity=newCapacity;
+    }
+    return 1;
+}
+static __inline void OutBufferAppend(OutBuffer* ob,const char* text,size_t len) {
+    if (len==0) return;     // (e.g. an empty quadtree stripe, whose data is NULL)
+    if (OutBufferReserve(ob,len)) {memcpy(&ob->data[ob->size],text,len);ob->size+=len;}
+}
+static __inline void OutBufferAppendChar(OutBuffer* ob,char c) {
+    if (ob->size<ob->capacity || OutBufferReserve(ob,1)) ob->data[ob->size++]=c;
+}
+static __inline int OutBufferAppendInt(OutBuffer* ob,long v) {
+    char tmp[24];const int len = sprintf(tmp,"%ld",v);
+    OutBufferAppend(ob,tmp,(size_t)len);return len;
+}
+
+
+// What the index encoders need to know about the image
+typedef struct {
+    int w,h,numPaletteColors,numCharsPerLine;
+    int narrowIndexType;    // NARROW_INDEX_TYPE_XXX (used by the encodings with narrow int types only)
+    const unsigned char* transparentIndices;    // 1 for the fully transparent palette indices (used by ENCODING_SPANS only)
+} EncoderParams;
+
+
+// Char mode: index j<=76 is written as '0'+j (skipping '\\'), and '~' + another char repeats the last index
+static __inline char IndexToChar(int j) {
+    char c = (char)(j+(int)'0');
+    if (c>='\\') c = (char) ((int)c+1);
+    ASSERT(c!='\\' && c>='0' && c<'~');
+    return c;
+}
+static __inline int IsTrigraphOrDigraph(char a,char b) {return (a=='?' && b=='?') || (a=='<' && b==':') || (a==':' && b=='>');}
+typedef struct {
+    OutBuffer* ob;
+    int numChars,numCharsPerLine;
+    char lastOut;
+} CharWriter;
+static __inline void CharWriterPut(CharWriter* cw,char c) {
+    if (cw->numChars==0) {OutBufferAppendChar(cw->ob,'"');cw->numChars=1;cw->lastOut='"';}
+    if (IsTrigraphOrDigraph(cw->lastOut,c)) {OutBufferAppend(cw->ob,"\"\"",2);cw->numChars+=2;}   // Trigraphs removal
+    OutBufferAppendChar(cw->ob,c);++cw->numChars;cw->lastOut=c;
+}
+static __inline void CharWriterEndToken(CharWriter* cw) {
+    if (cw->numChars>=cw->numCharsPerLine) {OutBufferAppend(cw->ob,"\"\n",2);cw->numChars=0;}
+}
+// Writes pIndices[start,end) as one or more lines of string literals, starting from a clean run state.
+// Every stripe starts and ends on its own line, so stripes can be encoded independently and concatenated.
+static void EncodeCharModeStripe(OutBuffer* ob,const unsigned short* pIndices,const EncoderParams* ep,int start,int end) {
+    CharWriter cw;
+    int i,numReps=0,lastIdx=-1;
+    cw.ob=ob;cw.numChars=0;cw.numCharsPerLine=ep->numCharsPerLine;cw.lastOut='\0';
+    for (i=start;i<=end;i++) {
+        const int j = i<end ? (int) pIndices[i] : -1;   // -1 flushes the last run
+        if (j==lastIdx && numReps<76) {++numReps;continue;}
+        if (numReps==1) {
+            // Write 'lastChar' (again)
+            CharWriterPut(&cw,IndexToChar(lastIdx));CharWriterEndToken(&cw);
+        }
+        else if (numReps>1) {
+            // Write '~' + numReps
+            CharWriterPut(&cw,'~');CharWriterPut(&cw,IndexToChar(numReps));CharWriterEndToken(&cw);
+        }
+        if (j>=0) {
+            // Write 'curChar'
+            CharWriterPut(&cw,IndexToChar(j));CharWriterEndToken(&cw);
+        }
+        lastIdx=j;numReps=0;
+    }
+    if (cw.numChars>0) OutBufferAppend(ob,"\"\n",2);
+}
+
+// Char mode v2: the alphabet is '!'..'~' without '"', ':', '?' and '\\' (90 symbols, no trigraphs, digraphs or escapes).
+// The string starts with the version ('2') and the number of direct indices D. Then every symbol value v is:
+// v<D: index v.  D<=v<89: index D+(v-D)*90+(next symbol value).  v==89: repeat the last index 1+N times,
+// where N is a little-endian varint of base-45 digits (a symbol value >=45 means that another digit follows).
+#define CHARS_V2_NUM_SYMBOLS    (90)
+#define CHARS_V2_RUN_SYMBOL     (89)
+#define CHARS_V2_MAX_COLORS     (4096)
+static __inline char ValueToCharV2(int v) {
+    char c = (char)(v+(int)'!');
+    ASSERT(v>=0 && v<CHARS_V2_NUM_SYMBOLS);
+    if (c>='"') ++c;
+    if (c>=':') ++c;
+    if (c>='?') ++c;
+    if (c>='\\') ++c;
+    return c;
+}
+static int GetCharsV2NumDirectIndices(int numPaletteColors) {
+    // The most frequent colors (the first ones) get one symbol, the others two
+    int d = numPaletteColors<CHARS_V2_RUN_SYMBOL ? numPaletteColors : CHARS_V2_RUN_SYMBOL-1;
+    while (d>0 && d+(CHARS_V2_RUN_SYMBOL-d)*CHARS_V2_NUM_SYMBOLS<numPaletteColors) --d;
+    return d;
+}
+static __inline int CharsV2VarintLength(unsigned long n) {int len=1;while (n>=45) {n/=45;++len;} return len;}
+static __inline int CharWriterPutIndexV2(CharWriter* cw,int j,int numDirect) {
+    if (j<numDirect) {CharWriterPut(cw,ValueToCharV2(j));CharWriterEndToken(cw);return 1;}
+    CharWriterPut(cw,ValueToCharV2(numDirect+(j-numDirect)/CHARS_V2_NUM_SYMBOLS));
+    CharWriterPut(cw,ValueToCharV2((j-numDirect)%CHARS_V2_NUM_SYMBOLS));
+    CharWriterEndToken(cw);return 2;
+}
+static void EncodeCharModeV2Stripe(OutBuffer* ob,const unsigned short* pIndices,const EncoderParams* ep,int start,int end) {
+    CharWriter cw;
+    const int numDirect = GetCharsV2NumDirectIndices(ep->numPaletteColors);
+    int i,lastIdx=-1,lastIdxLen=0;unsigned long numReps=0;
+    cw.ob=ob;cw.numChars=0;cw.numCharsPerLine=ep->numCharsPerLine;cw.lastOut='\0';
+    if (start==0) {CharWriterPut(&cw,'2');CharWriterPut(&cw,ValueToCharV2(numDirect));CharWriterEndToken(&cw);}
+    for (i=start;i<=end;i++) {
+        const int j = i<end ? (int) pIndices[i] : -1;   // -1 flushes the last run
+        if (j==lastIdx) {++numReps;continue;}
+        if (numReps>0) {
+            if ((unsigned long)lastIdxLen*numReps <= (unsigned long)(1+CharsV2VarintLength(numReps-1))) {
+                // Write 'lastIdx' (again), since it's shorter
+                for (;numReps>0;--numReps) CharWriterPutIndexV2(&cw,lastIdx,numDirect);
+            }
+            else {
+                // Write the run symbol + varint(numReps-1)
+                unsigned long n = numReps-1;
+                CharWriterPut(&cw,ValueToCharV2(CHARS_V2_RUN_SYMBOL));
+                while (n>=45) {CharWriterPut(&cw,ValueToCharV2(45+(int)(n%45)));n/=45;}
+                CharWriterPut(&cw,ValueToCharV2((int)n));
+                CharWriterEndToken(&cw);
+            }
+        }
+        if (j>=0) {
+            // Write 'j' (one or two symbols)
+            lastIdxLen = CharWriterPutIndexV2(&cw,j,numDirect);
+        }
+        lastIdx=j;numReps=0;
+    }
+    if (cw.numChars>0) OutBufferAppend(ob,"\"\n",2);
+}
+
+// Int mode: non-negative values are indices, negative values represent further repetitions of the last index
+typedef struct {
+    OutBuffer* ob;
+    int numChars,numCharsPerLine,numValues;
+} IntWriter;
+static __inline void IntWriterPut(IntWriter* iw,long v) {
+    if (iw->numValues++>0) {
+        OutBufferAppendChar(iw->ob,',');++iw->numChars;
+        if (iw->numChars>=iw->numCharsPerLine) {OutBufferAppendChar(iw->ob,'\n');iw->numChars=0;}
+    }
+    iw->numChars+=OutBufferAppendInt(iw->ob,v);
+}
+static void EncodeIntModeStripe(OutBuffer* ob,const unsigned short* pIndices,const EncoderParams* ep,int start,int end) {
+    IntWriter iw;
+    int i,numReps=0,lastIdx=-1;
+    iw.ob=ob;iw.numChars=0;iw.numCharsPerLine=ep->numCharsPerLine;iw.numValues=0;
+    for (i=start;i<=end;i++) {
+        const int j = i<end ? (int) pIndices[i] : -1;   // -1 flushes the last run
+        if (j==lastIdx) {++numReps;continue;}
+        if (numReps==1) IntWriterPut(&iw,lastIdx);      // Write 'lastIdx' (again)
+        else if (numReps>1) IntWriterPut(&iw,-numReps); // Write '-numReps'
+        if (j>=0) IntWriterPut(&iw,j);                  // Write 'j'
+        lastIdx=j;numReps=0;
+    }
+}
+
+// 1bpp mode (max 2 colors): rows are packed MSB-first (each row padded to whole bytes).
+// Bytes 0x00 and 0xFF are always followed by their number of repetitions in [1,255].
+typedef struct {
+    IntWriter iw;
+    int lastByte,numReps;
+} ByteRunWriter;
+static void ByteRunWriterPut(ByteRunWriter* bw,int b) {   // b<0 flushes the last run
+    if (b>=0 && b==bw->lastByte && bw->numReps<255) {++bw->numReps;return;}
+    if (bw->numReps>0) IntWriterPut(&bw->iw,bw->numReps);  // Write the number of repetitions of 0x00 or 0xFF
+    bw->numReps=0;bw->lastByte=-1;
+    if (b<0) return;
+    IntWriterPut(&bw->iw,b);
+    if (b==0x00 || b==0xFF) {bw->numReps=1;bw->lastByte=b;}
+}
+static void Encode1bppStripe(OutBuffer* ob,const unsigned short* pIndices,const EncoderParams* ep,int start,int end) {
+    ByteRunWriter bw;
+    const int w = ep->w;
+    int i,x,k,b;
+    bw.iw.ob=ob;bw.iw.numChars=0;bw.iw.numCharsPerLine=ep->numCharsPerLine;bw.iw.numValues=0;
+    bw.lastByte=-1;bw.numReps=0;
+    ASSERT(start%w==0 && end%w==0);
+    for (i=start;i<end;i+=w) {
+        for (x=0;x<w;x+=8) {
+            for (b=0,k=0;k<8;k++) {
+                b<<=1;
+                if (x+k<w) {ASSERT(pIndices[i+x+k]<2);b|=(int)pIndices[i+x+k];}
+            }
+            ByteRunWriterPut(&bw,b);
+        }
+    }
+    ByteRunWriterPut(&bw,-1);
+}
+
+// Narrow int mode: values are written as unsigned char, unsigned short or unsigned int (the smallest result wins).
+// Values <numPaletteColors are indices. numPaletteColors is followed by the number of further repetitions of the last index.
+enum {NARROW_INDEX_TYPE_U8=0,NARROW_INDEX_TYPE_U16,NARROW_INDEX_TYPE_U32,NARROW_INDEX_TYPE_COUNT};
+static const unsigned long narrowIndexTypeMaxValues[NARROW_INDEX_TYPE_COUNT] = {255UL,65535UL,4294967295UL};
+static const int narrowIndexTypeSizes[NARROW_INDEX_TYPE_COUNT] = {1,2,4};
+static const char* narrowIndexTypeNames[NARROW_INDEX_TYPE_COUNT] = {"unsigned char","unsigned short","unsigned int"};
+static const char* narrowIndexTypeSuffixes[NARROW_INDEX_TYPE_COUNT] = {"U8","U16","U32"};
+static int ChooseNarrowIndexType(const unsigned short* pIndices,int area,int numPaletteColors) {
+    unsigned long numValues[NARROW_INDEX_TYPE_COUNT] = {0,0,0},numReps=0;
+    int i,t,best=NARROW_INDEX_TYPE_U32,lastIdx=-1;
+    for (i=0;i<=area;i++) {
+        const int j = i<area ? (int) pIndices[i] : -1;
+        if (j==lastIdx) {++numReps;continue;}
+        for (t=0;t<NARROW_INDEX_TYPE_COUNT;t++) {
+            if (numReps<=2) numValues[t]+=numReps;
+            else numValues[t]+=2*((numReps+narrowIndexTypeMaxValues[t]-1)/narrowIndexTypeMaxValues[t]);
+            if (j>=0) ++numValues[t];
+        }
+        lastIdx=j;numReps=0;
+    }
+    for (t=NARROW_INDEX_TYPE_COUNT-1;t>=0;--t) {
+        if ((unsigned long)numPaletteColors>narrowIndexTypeMaxValues[t]) continue;
+        if (numValues[t]*narrowIndexTypeSizes[t]<=numValues[best]*narrowIndexTypeSizes[best]) best=t;
+    }
+    return best;
+}
+static void EncodeIntModeNarrowStripe(OutBuffer* ob,const unsigned short* pIndices,const EncoderParams* ep,int start,int end) {
+    IntWriter iw;
+    const unsigned long maxValue = narrowIndexTypeMaxValues[ep->narrowIndexType];
+    int i,lastIdx=-1;unsigned long numReps=0;
+    iw.ob=ob;iw.numChars=0;iw.numCharsPerLine=ep->numCharsPerLine;iw.numValues=0;
+    for (i=start;i<=end;i++) {
+        const int j = i<end ? (int) pIndices[i] : -1;   // -1 flushes the last run
+        if (j==lastIdx) {++numReps;continue;}
+        if (numReps<=2) {for (;numReps>0;--numReps) IntWriterPut(&iw,lastIdx);}   // Write 'lastIdx' (again)
+        else {
+            for (;numReps>0;numReps-=(numReps<maxValue?numReps:maxValue)) {
+                // Write 'numPaletteColors' and the number of repetitions
+                IntWriterPut(&iw,ep->numPaletteColors);
+                IntWriterPut(&iw,(long)(numReps<maxValue?numReps:maxValue));
+            }
+        }
+        if (j>=0) IntWriterPut(&iw,j);                  // Write 'j'
+        lastIdx=j;numReps=0;
+    }
+}
+
+// Quadtree mode: the image is split into QUADTREE_BLOCK_SIZE blocks, and each block is a tree of square nodes (in the narrow int types).
+// Values <numPaletteColors fill a whole node, numPaletteColors splits it into 4 children (the ones outside the image are skipped).
+#define QUADTREE_BLOCK_SIZE (64)    // (hard-coded in the decoders)
+static int GetUniformNodeIndex(const unsigned short* pIndices,int w,int h,int x,int y,int size) {
+    const int xEnd = x+size<w ? x+size : w, yEnd = y+size<h ? y+size : h;
+    const unsigned short idx = pIndices[y*w+x];
+    int i,j;
+    for (j=y;j<yEnd;j++) {
+        const unsigned short* row = &pIndices[j*w];
+        for (i=x;i<xEnd;i++) {if (row[i]!=idx) return -1;}
+    }
+    return (int) idx;
+}
+static void EncodeQuadtreeNode(IntWriter* iw,const unsigned short* pIndices,const EncoderParams* ep,int x,int y,int size) {
+    const int idx = GetUniformNodeIndex(pIndices,ep->w,ep->h,x,y,size), half = size/2;
+    if (idx>=0) {IntWriterPut(iw,idx);return;}
+    IntWriterPut(iw,ep->numPaletteColors);
+    EncodeQuadtreeNode(iw,pIndices,ep,x,y,half);
+    if (x+half<ep->w) EncodeQuadtreeNode(iw,pIndices,ep,x+half,y,half);
+    if (y+half<ep->h) {
+        EncodeQuadtreeNode(iw,pIndices,ep,x,y+half,half);
+        if (x+half<ep->w) EncodeQuadtreeNode(iw,pIndices,ep,x+half,y+half,half);
+    }
+}
+static void EncodeQuadtreeStripe(OutBuffer* ob,const unsigned short* pIndices,const EncoderParams* ep,int start,int end) {
+    // Every row of blocks is encoded by the stripe that contains its first row (so some stripes can be empty)
+    const int startRow = start/ep->w, endRow = end/ep->w;
+    int x,y;IntWriter iw;
+    iw.ob=ob;iw.numChars=0;iw.numCharsPerLine=ep->numCharsPerLine;iw.numValues=0;
+    for (y=(startRow+QUADTREE_BLOCK_SIZE-1)/QUADTREE_BLOCK_SIZE*QUADTREE_BLOCK_SIZE;y<endRow;y+=QUADTREE_BLOCK_SIZE) {
+        for (x=0;x<ep->w;x+=QUADTREE_BLOCK_SIZE) EncodeQuadtreeNode(&iw,pIndices,ep,x,y,QUADTREE_BLOCK_SIZE);
+    }
+}
+static int ChooseQuadtreeIndexType(int numPaletteColors) {
+    return numPaletteColors<=(int)narrowIndexTypeMaxValues[NARROW_INDEX_TYPE_U8] ? NARROW_INDEX_TYPE_U8 : NARROW_INDEX_TYPE_U16;   // (the largest value is numPaletteColors)
+}
+
+// Spans mode (sprites): for each row the number of spans of non-transparent pixels, then the x, the length and the indices of each span
+static void EncodeSpansStripe(OutBuffer* ob,const unsigned short* pIndices,const EncoderParams* ep,int start,int end) {
+    const unsigned char* transparent = ep->transparentIndices;
+    int i,x,x0,numSpans;IntWriter iw;
+    iw.ob=ob;iw.numChars=0;iw.numCharsPerLine=ep->numCharsPerLine;iw.numValues=0;
+    for (i=start;i<end;i+=ep->w) {
+        const unsigned short* row = &pIndices[i];
+        for (x=0,numSpans=0;x<ep->w;) {
+            if (transparent[row[x]]) {++x;continue;}
+            for (++numSpans;x<ep->w && !transparent[row[x]];x++) {}
+        }
+        IntWriterPut(&iw,numSpans);
+        for (x=0;x<ep->w;) {
+            if (transparent[row[x]]) {++x;continue;}
+            for (x0=x;x<ep->w && !transparent[row[x]];x++) {}
+            IntWriterPut(&iw,x0);IntWriterPut(&iw,x-x0);
+            for (;x0<x;x0++) IntWriterPut(&iw,row[x0]);
+        }
+    }
+}
+static int ChooseSpansIndexType(int w,int numPaletteColors) {
+    const unsigned long maxValue = (unsigned long)(w>numPaletteColors-1 ? w : numPaletteColors-1);  // (x, length or index)
+    return maxValue<=narrowIndexTypeMaxValues[NARROW_INDEX_TYPE_U8] ? NARROW_INDEX_TYPE_U8 :
+          (maxValue<=narrowIndexTypeMaxValues[NARROW_INDEX_TYPE_U16] ? NARROW_INDEX_TYPE_U16 : NARROW_INDEX_TYPE_U32);
+}
+
+// Splits the image into horizontal stripes that are encoded concurrently and then appended to 'out'.
+// The stripe height does not depend on the number of threads (so neither does the output).
+#ifndef STRIPE_NUM_PIXELS
+#   define STRIPE_NUM_PIXELS (1<<16)
+#endif
+typedef void (*StripeEncoderFunc)(OutBuffer* ob,const unsigned short* pIndices,const EncoderParams* ep,int start,int end);
+typedef struct {
+    StripeEncoderFunc encoder;
+    const unsigned short* pIndices;
+    const EncoderParams* ep;
+    int area,stripeSize;
+    OutBuffer* stripes;
+} StripeJobData;
+static void StripeJob(void* userData,int jobIndex) {
+    StripeJobData* d = (StripeJobData*) userData;
+    const int start = jobIndex*d->stripeSize;
+    const int end = start+d->stripeSize<d->area ? start+d->stripeSize : d->area;
+    d->encoder(&d->stripes[jobIndex],d->pIndices,d->ep,start,end);
+}
+static int EncodeStripes(OutBuffer* out,StripeEncoderFunc encoder,const char* separator,const unsigned short* pIndices,const EncoderParams* ep,int numThreads) {
+    StripeJobData d;int i,numStripes,ok=1;
+    const int w = ep->w, h = ep->h;
+    const int stripeRows = w>=STRIPE_NUM_PIXELS ? 1 : (STRIPE_NUM_PIXELS+w-1)/w;
+    numStripes = (h+stripeRows-1)/stripeRows;
+    if (numStripes<1) numStripes=1;
+    d.encoder=encoder;d.pIndices=pIndices;d.ep=ep;d.area=w*h;d.stripeSize=stripeRows*w;
+    d.stripes = (OutBuffer*) calloc(numStripes,sizeof(OutBuffer));
+    if (!d.stripes) return 0;
+    ParallelFor(numStripes,&StripeJob,&d,numThreads);
+    for (i=0;i<numStripes;i++) {
+        if (d.stripes[i].failed) ok=0;
+        if (out->size>0 && d.stripes[i].size>0 && separator) OutBufferAppend(out,separator,strlen(separator));
+        OutBufferAppend(out,d.stripes[i].data,d.stripes[i].size);
+        OutBufferFree(&d.stripes[i]);
+    }
+    free(d.stripes);
+    return ok && !out->failed;
+}
+
+
+// How the indices are written to the .inl file
+enum {ENCODING_CHARS=0,ENCODING_INTS,ENCODING_1BPP,ENCODING_CHARS_V2,ENCODING_INTS_NARROW,ENCODING_PROGRESSIVE,ENCODING_QUADTREE,ENCODING_SPANS,ENCODING_COUNT};
+typedef struct {
+    StripeEncoderFunc encoder;
+    const char* stripeSeparator;
+    const char* declaration;        // printf format (with width, height and the narrow index type name)
+    const char* closing;
+    const char** usage;             // RGBA palette ($T and $N are replaced by the narrow index type and its suffix)
+    const char** usage8;            // 8-bit palette (PIXEL_FORMAT_R8 or PIXEL_FORMAT_A8)
+    const char** usageIndices;      // --index-output (NULL if not available)
+    const char** usageRect;         // --rect-output (NULL if not available)
+} EncodingInfo;
+static const EncodingInfo encodingInfos[ENCODING_COUNT] = {
+    {&EncodeCharModeStripe,NULL,
+     "/* Each entry when uncompressed to %d*%d represents an index into the palette array */\nconst char* indices[] = {\n",
+     "};\n\n",decodeImageUsage,decodeImage8Usage,decodeImageIndicesUsage,decodeImageRectUsage},
+    {&EncodeIntModeStripe,",\n",
+     "/* int indices into palette (%dx%d once uncompressed). Negative values represent further repetitions of the last index */\nconst int indices[] = {\n",
+     "\n};\n\n",decodeImageIntUsage,decodeImageInt8Usage,decodeImageIntIndicesUsage,decodeImageIntRectUsage},
+    {&Encode1bppStripe,",\n",
+     "/* 1 bit per pixel (%dx%d once uncompressed): each row is packed MSB-first into whole bytes. 0x00 and 0xFF are followed by their number of repetitions */\nconst unsigned char indices[] = {\n",
+     "\n};\n\n",decodeImage1bppUsage,decodeImage1bpp8Usage,decodeImage1bppIndicesUsage,decodeImage1bppRectUsage},
+    {&EncodeCharModeV2Stripe,NULL,
+     "/* Char mode v2 (%dx%d once uncompressed): see DecodeImageV2(...) */\nconst char* indices[] = {\n",
+     "};\n\n",decodeImageV2Usage,decodeImageV2_8Usage,decodeImageV2IndicesUsage,decodeImageV2RectUsage},
+    {&EncodeIntModeNarrowStripe,",\n",
+     "/* indices into palette (%dx%d once uncompressed). A value equal to the palette size is followed by the number of further repetitions of the last index */\nconst %s indices[] = {\n",
+     "\n};\n\n",decodeImageIntNarrowUsage,decodeImageIntNarrow8Usage,decodeImageIntNarrowIndicesUsage,decodeImageIntNarrowRectUsage},
+    {&EncodeIntModeNarrowStripe,",\n",
+     "/* indices into palette in progressive order: the 7 passes of Adam7 interlacing (%dx%d once decoded). A value equal to the palette size is followed by the number of further repetitions of the last index */\nconst %s indices[] = {\n",
+     "\n};\n\n",decodeImageProgressiveUsage,decodeImageProgressive8Usage,NULL,NULL},
+    {&EncodeQuadtreeStripe,",\n",
+     "/* quadtree of indices into palette (%dx%d once decoded, in 64x64 blocks). A value equal to the palette size splits a node into 4: see DecodeImageQuadtree(...) */\nconst %s indices[] = {\n",
+     "\n};\n\n",decodeImageQuadtreeUsage,decodeImageQuadtree8Usage,decodeImageQuadtreeIndicesUsage,decodeImageQuadtreeRectUsage},
+    {&EncodeSpansStripe,",\n",
+     "/* spans of non-transparent pixels (%dx%d sprite): for each row the number of spans, then the x, the length and the indices into palette of each span. See BlitSprite(...) */\nconst %s indices[] = {\n",
+     "\n};\n\n",blitSpriteUsage,blitSprite8Usage,blitSpriteIndicesUsage,NULL}
+};
+
+// Everything written to the .inl file goes through these, so that --stats can report its size
+// (ftell(...) means nothing for pipes and devices like /dev/null)
+static long numBytesOut = 0;
+static int OutPrintf(FILE* f,const char* format,...) {
+    va_list args;int n;
+    va_start(args,format);n = vfprintf(f,format,args);va_end(args);
+    if (n>0) numBytesOut+=n;
+    return n;
+}
+static void OutPuts(const char* s,FILE* f) {if (fputs(s,f)>=0) numBytesOut+=(long)strlen(s);}
+static void OutPutc(int c,FILE* f) {if (fputc(c,f)!=EOF) ++numBytesOut;}
+static void OutWrite(const void* data,size_t size,FILE* f) {numBytesOut+=(long)fwrite(data,1,size,f);}
+
+// Writes 'text' replacing $T, $N and $I with 'indexType', 'nameSuffix' and 'outputIndexType'
+static void WriteUsage(FILE* f,const char* text,const char* indexType,const char* nameSuffix,const char* outputIndexType) {
+    const char* pc;
+    for (pc=text;*pc!='\0';++pc) {
+        if (pc[0]=='$' && pc[1]=='T') {OutPuts(indexType,f);++pc;}
+        else if (pc[0]=='$' && pc[1]=='N') {OutPuts(nameSuffix,f);++pc;}
+        else if (pc[0]=='$' && pc[1]=='I') {OutPuts(outputIndexType,f);++pc;}
+        else OutPutc(*pc,f);
+    }
+}
+
+// Writes 'text' replacing $T and $N like WriteUsage(...), $P and $S with 'pixelType' and 'pixelSuffix', $L (the palette argument of the examples)
+// with 'paletteArg', and $E (after the declarations) with the big endian palette swap of the RGBA decoders (--rect-output)
+static void WriteRectUsage(FILE* f,const char* text,const char* indexType,const char* nameSuffix,const char* pixelType,const char* pixelSuffix,const char* paletteArg) {
+    const char* pc;
+    for (pc=text;*pc!='\0';++pc) {
+        if (pc[0]=='$' && pc[1]=='T') {OutPuts(indexType,f);++pc;}
+        else if (pc[0]=='$' && pc[1]=='N') {OutPuts(nameSuffix,f);++pc;}
+        else if (pc[0]=='$' && pc[1]=='P') {OutPuts(pixelType,f);++pc;}
+        else if (pc[0]=='$' && pc[1]=='S') {OutPuts(pixelSuffix,f);++pc;}
+        else if (pc[0]=='$' && pc[1]=='L') {OutPuts(paletteArg,f);++pc;}
+        else if (pc[0]=='$' && pc[1]=='E') {
+            if (strcmp(pixelType,"unsigned")==0) OutPuts("#   ifdef USE_BIG_ENDIAN_MACHINE\n    unsigned paletteBE[PALETTE_BE_SIZE];\n    if (palette) palette = SwapPaletteBE(paletteBE,palette);\n#   endif\n",f);
+            ++pc;
+        }
+        else OutPutc(*pc,f);
+    }
+}
+
+// Writes DecodeImageSpecialized(...) or DecodeImageSpecialized8(...) for the char and int modes (--specialize): the same decoding,
+// but the number of pixels, the palette size and the longest run are written as constants, and branches this image never takes are left out.
+// Returns 0 if the encoding has no specialized decoder.
+static int WriteSpecializedDecoder(FILE* f,int encoding,const unsigned short* pIndices,const EncoderParams* ep,int pixelFormat) {
+    const int area = ep->w*ep->h, isRGBA = pixelFormat==PIXEL_FORMAT_RGBA;
+    const char* pixelType = isRGBA ? "unsigned" : "unsigned char";
+    unsigned long maxReps=0,numReps=0,maxRun;
+    int i,unroll,lastIdx=-1;
+    if (encoding!=ENCODING_CHARS && encoding!=ENCODING_INTS && encoding!=ENCODING_INTS_NARROW) return 0;
+    for (i=0;i<area;i++) {
+        // 'maxReps' is the longest run of further repetitions (stripes can only split runs, so it's an upper bound)
+        if ((int)pIndices[i]==lastIdx) {if (++numReps>maxReps) maxReps=numReps;}
+        else {lastIdx=pIndices[i];numReps=0;}
+    }
+    // Longest run token of the encoding (0 if there are no run tokens)
+    if (encoding==ENCODING_CHARS) maxRun = maxReps<2 ? 0 : (maxReps<76 ? maxReps : 76);
+    else if (encoding==ENCODING_INTS) maxRun = maxReps<2 ? 0 : maxReps;
+    else maxRun = maxReps<3 ? 0 : (maxReps<narrowIndexTypeMaxValues[ep->narrowIndexType] ? maxReps : narrowIndexTypeMaxValues[ep->narrowIndexType]);
+    unroll = maxRun>=8 ? 8 : (maxRun>=4 ? 4 : 2);
+
+    OutPrintf(f,"\n/* Decoder specialized for this image (--specialize): the number of pixels (%d) and the palette size (%d) are compile-time constants,\n",area,ep->numPaletteColors);
+    if (maxRun>0) OutPrintf(f,"   the run fills (up to %lu repetitions) are unrolled and the output does not alias the input, so that the compiler can vectorize it */\n",maxRun);
+    else OutPrintf(f,"   this image has no runs (so there is no run branch) and the output does not alias the input */\n");
+    OutPrintf(f,"#ifndef DECODE_RESTRICT\n");
+    OutPrintf(f,"#   if defined(__GNUC__) || defined(_MSC_VER)\n");
+    OutPrintf(f,"#       define DECODE_RESTRICT __restrict\n");
+    OutPrintf(f,"#   elif defined(__STDC_VERSION__) && __STDC_VERSION__>=199901L\n");
+    OutPrintf(f,"#       define DECODE_RESTRICT restrict\n");
+    OutPrintf(f,"#   else\n");
+    OutPrintf(f,"#       define DECODE_RESTRICT\n");
+    OutPrintf(f,"#   endif\n");
+    OutPrintf(f,"#endif\n");
+    OutPrintf(f,"void DecodeImageSpecialized%s(%s* DECODE_RESTRICT pPixelsOut,const %s* DECODE_RESTRICT palette,const %s* DECODE_RESTRICT indices) {\n",isRGBA ? "" : "8",pixelType,pixelType,
+            encoding==ENCODING_CHARS ? "char" : (encoding==ENCODING_INTS ? "int" : narrowIndexTypeNames[ep->narrowIndexType]));
+    OutPrintf(f,"    %s* pRaw = pPixelsOut;%s* const pEnd = pPixelsOut+%d;\n",pixelType,pixelType,area);
+    if (encoding==ENCODING_CHARS) OutPrintf(f,"    const unsigned char* pc = (const unsigned char*) indices;\n");
+    if (maxRun>0) OutPrintf(f,"    %s pal=0;int n;\n",pixelType);
+    if (isRGBA) {
+        OutPrintf(f,"#   ifdef USE_BIG_ENDIAN_MACHINE\n");
+        OutPrintf(f,"    unsigned paletteBE[PALETTE_BE_SIZE];\n");
+        OutPrintf(f,"    palette = SwapPaletteBE(paletteBE,palette);\n");
+        OutPrintf(f,"#   endif\n");
+    }
+    OutPrintf(f,"    while (pRaw<pEnd) {\n");
+    if (maxRun>0) {
+        if (encoding==ENCODING_CHARS) {
+            OutPrintf(f,"        if (*pc=='~') {   /* '~' + another char: further repetitions of the last color */\n");
+            OutPrintf(f,"            n = %s;pc+=2;\n",maxRun<44 ? "pc[1]-'0'" : "pc[1]>='\\\\' ? pc[1]-'1' : pc[1]-'0'");
+        }
+        else if (encoding==ENCODING_INTS) {
+            OutPrintf(f,"        if (*indices<0) {   /* negative values: further repetitions of the last color */\n");
+            OutPrintf(f,"            n = -*indices++;\n");
+        }
+        else {
+            OutPrintf(f,"        if (*indices==%d) {   /* the palette size is followed by the number of further repetitions */\n",ep->numPaletteColors);
+            OutPrintf(f,"            n = (int) indices[1];indices+=2;\n");
+        }
+        if (maxRun>=(unsigned long)unroll) {
+            OutPrintf(f,"            for (;n>=%d;n-=%d) {",unroll,unroll);
+            for (i=0;i<unroll;i++) OutPrintf(f,"pRaw[%d]=pal;",i);
+            OutPrintf(f,"pRaw+=%d;}\n",unroll);
+        }
+        OutPrintf(f,"            for (;n>0;--n) *pRaw++ = pal;\n");
+        OutPrintf(f,"            continue;\n");
+        OutPrintf(f,"        }\n");
+    }
+    if (encoding==ENCODING_CHARS) OutPrintf(f,"        *pRaw++ = %spalette[%s];++pc;\n",maxRun>0 ? "pal = " : "",ep->numPaletteColors<=44 ? "*pc-'0'" : "*pc>='\\\\' ? *pc-'1' : *pc-'0'");
+    else OutPrintf(f,"        *pRaw++ = %spalette[*indices++];\n",maxRun>0 ? "pal = " : "");
+    OutPrintf(f,"    }\n");
+    OutPrintf(f,"}\n\n");
+    OutPrintf(f,"// %s raw[width*height];\n",isRGBA ? "unsigned int" : "unsigned char");
+    OutPrintf(f,"// DecodeImageSpecialized%s(&raw[0],palette,%sindices);\n",isRGBA ? "" : "8",encoding==ENCODING_CHARS ? "*" : "");
+    return 1;
+}
+
+
+// Writes the image dimensions, the --trim offset and the --tiles tilemap
+static void WriteImageHeader(FILE* f,int w,int h,int trimOptionUsed,int trimX,int trimY,int originalWidth,int originalHeight,const Tileset* tileset,int numCharsPerLine) {
+    int j,numChars = 0;
+    OutPrintf(f,"const int width = %d, height = %d;\n\n",w,h);
+    if (trimOptionUsed) {
+        OutPrintf(f,"/* Fully transparent borders were cropped: this image starts at (trimX,trimY) in the original image */\n");
+        OutPrintf(f,"const int trimX = %d, trimY = %d, originalWidth = %d, originalHeight = %d;\n\n",trimX,trimY,originalWidth,originalHeight);
+    }
+    if (tileset->tilemap) {
+        const int numEntries = tileset->tilemapWidth*tileset->tilemapHeight;
+        OutPrintf(f,"/* The image above is a column of 'numTiles' unique tiles of tileSize x tileSize pixels. 'tilemap' places them in the original image: */\n");
+        OutPrintf(f,"/* tile index in the low 13 bits, then flip x (0x2000), flip y (0x4000) and transpose (0x8000). See ExpandTilemap(...) */\n");
+        OutPrintf(f,"const int tileSize = %d, numTiles = %d, tilemapWidth = %d, tilemapHeight = %d;\n",tileset->tileSize,tileset->numTiles,tileset->tilemapWidth,tileset->tilemapHeight);
+        OutPrintf(f,"const unsigned short tilemap[%d] = {\n",numEntries);
+        for (j=0;j<numEntries;j++) {
+            numChars+=OutPrintf(f,j<numEntries-1 ? "%u," : "%u",(unsigned)tileset->tilemap[j]);
+            if (numChars>=numCharsPerLine) {OutPrintf(f,"\n");numChars=0;}
+        }
+        OutPrintf(f,"\n};\n\n");
+    }
+}
+
+
+// --auto: every candidate encoding is emitted into its own buffer (concurrently) and parsed back into the data that
+// the compiler stores (the string or the array values), to measure its size and, if needed, its decoding time
+enum {AUTO_TARGET_NONE=0,AUTO_TARGET_SIZE,AUTO_TARGET_DECODE_SPEED,AUTO_TARGET_BALANCED,AUTO_TARGET_COUNT};
+static const char* autoTargetNames[AUTO_TARGET_COUNT] = {"","size","decode-speed","balanced"};
+static const char* encodingNames[ENCODING_COUNT] = {"chars","ints","1bpp","chars v2","narrow ints","progressive","quadtree","spans"};
+static const char* encodingOptions[ENCODING_COUNT] = {"","--ints","--1bpp","--v2","--narrow","--progressive","--quadtree","--spans"};
+#ifndef AUTO_MIN_BENCHMARK_MS
+#   define AUTO_MIN_BENCHMARK_MS (50.0)     // every candidate is decoded at least 3 times and for about this time...
+#endif
+#ifndef AUTO_MAX_NUM_BENCHMARK_RUNS
+#   define AUTO_MAX_NUM_BENCHMARK_RUNS (100) // ...but no more than this number of times
+#endif
+#ifndef AUTO_TIE_TOLERANCE
+#   define AUTO_TIE_TOLERANCE (0.1)         // timing-based scores within 10% of the best one are ties (broken by size, then by encoding)
+#endif
+typedef struct {
+    int encoding;
+    EncoderParams ep;
+    void* data;             // malloc'ed string (chars modes) or array values (NULL if out of memory)
+    size_t numValues,dataSize;
+    double decodeMs;        // best time of all the runs (or 0 if not measured)
+} AutoCandidate;
+typedef struct {
+    AutoCandidate* candidates;
+    const unsigned short* pIndices;
+} AutoJobData;
+
+// Parses 'ob' back into a malloc'ed string (isString) or array of 'valueSize' bytes values
+static void* ParseEmittedIndices(const OutBuffer* ob,int isString,int valueSize,size_t* pNumValues) {
+    const char *pc = ob->data, *end = ob->data+ob->size;
+    size_t n = 0;
+    if (isString) {
+        char* s = (char*) malloc(ob->size+1);int inside = 0;
+        if (!s) return NULL;
+        for (;pc<end;++pc) {
+            if (*pc=='"') inside = !inside;
+            else if (inside) s[n++] = *pc;    // (no escape sequences are ever emitted)
+        }
+        s[n]='\0';*pNumValues=n;
+        return s;
+    }
+    else {
+        unsigned char* a = (unsigned char*) malloc((ob->size/2+1)*(size_t)valueSize);   // every value but the last one is followed by ','
+        if (!a) return NULL;
+        while (pc<end) {
+            long v = 0;int negative = 0;
+            if (*pc!='-' && (*pc<'0' || *pc>'9')) {++pc;continue;}
+            if (*pc=='-') {negative=1;++pc;}
+            while (pc<end && *pc>='0' && *pc<='9') v = v*10+(*pc++-'0');
+            if (negative) v=-v;
+            if (valueSize==1) a[n] = (unsigned char) v;
+            else if (valueSize==2) ((unsigned short*)a)[n] = (unsigned short) v;
+            else ((int*)a)[n] = (int) v;
+            ++n;
+        }
+        *pNumValues=n;
+        return a;
+    }
+}
+
+static void AutoEncodeJob(void* userData,int jobIndex) {
+    AutoJobData* d = (AutoJobData*) userData;
+    AutoCandidate* c = &d->candidates[jobIndex];
+    const EncodingInfo* ei = &encodingInfos[c->encoding];
+    const int isString = ei->stripeSeparator==NULL;
+    const int valueSize = c->encoding==ENCODING_INTS ? (int)sizeof(int) : (c->encoding==ENCODING_1BPP ? 1 : narrowIndexTypeSizes[c->ep.narrowIndexType]);
+    OutBuffer out = {NULL,0,0,0};
+    c->data = NULL;c->numValues = c->dataSize = 0;c->decodeMs = 0;
+    if (EncodeStripes(&out,ei->encoder,ei->stripeSeparator,d->pIndices,&c->ep,1)) {
+        c->data = ParseEmittedIndices(&out,isString,valueSize,&c->numValues);
+        c->dataSize = isString ? c->numValues+1 : c->numValues*(size_t)valueSize;
+    }
+    OutBufferFree(&out);
+}
+
+// The same algorithms as the decoders in the usage section (RGBA output)
+#define DECODE_NARROW_FOR_BENCHMARK(TYPE) {                                                 \
+    const TYPE* ind = (const TYPE*) c->data;                                                \
+    for (i=0;i<c->numValues;i++) {                                                          \
+        if ((unsigned)ind[i]!=numPalette) {idx = ind[i];*p++ = palette[idx];}               \
+        else for (n=ind[++i];n>0;--n) *p++ = palette[idx];                                  \
+    }                                                                                       \
+}
+#define DEFINE_DECODE_QUADTREE_NODE_FOR_BENCHMARK(NAME,TYPE)                                 \
+static const TYPE* NAME(unsigned* pixels,int w,int h,int x,int y,int size,const unsigned* palette,unsigned numPalette,const TYPE* ind) { \
+    if (*ind==numPalette) {                                                                 \
+        const int half = size/2;                                                            \
+        ind = NAME(pixels,w,h,x,y,half,palette,numPalette,ind+1);                           \
+        if (x+half<w) ind = NAME(pixels,w,h,x+half,y,half,palette,numPalette,ind);          \
+        if (y+half<h) {                                                                     \
+            ind = NAME(pixels,w,h,x,y+half,half,palette,numPalette,ind);                    \
+            if (x+half<w) ind = NAME(pixels,w,h,x+half,y+half,half,palette,numPalette,ind); \
+        }                                                                                   \
+    }                                                                                       \
+    else {                                                                                  \
+        const unsigned value = palette[*ind++];                                             \
+        const int nw = x+size<w ? size : w-x, nh = y+size<h ? size : h-y;                   \
+        unsigned* p = &pixels[y*w+x];int i,j;                                               \
+        for (j=0;j<nh;j++,p+=w) {for (i=0;i<nw;i++) p[i] = value;}                          \
+    }                                                                                       \
+    return ind;                                                                             \
+}
+DEFINE_DECODE_QUADTREE_NODE_FOR_BENCHMARK(DecodeQuadtreeNodeU8ForBenchmark,unsigned char)
+DEFINE_DECODE_QUADTREE_NODE_FOR_BENCHMARK(DecodeQuadtreeNodeU16ForBenchmark,unsigned short)
+#undef DEFINE_DECODE_QUADTREE_NODE_FOR_BENCHMARK
+static void DecodeForBenchmark(unsigned* pixels,const unsigned* palette,const AutoCandidate* c) {
+    const unsigned numPalette = (unsigned) c->ep.numPaletteColors;
+    unsigned* p = pixels;size_t i;unsigned idx = 0,n;
+    switch (c->encoding) {
+    case ENCODING_CHARS: {
+        const char* pc;
+        for (pc=(const char*)c->data;*pc!='\0';++pc) {
+            if (*pc=='~') {++pc;for (n=(unsigned)(*pc>='\\' ? *pc-'1' : *pc-'0');n>0;--n) *p++ = palette[idx];}
+            else {idx = (unsigned)(*pc>='\\' ? *pc-'1' : *pc-'0');*p++ = palette[idx];}
+        }
+    }
+    break;
+    case ENCODING_INTS: {
+        const int* ind = (const int*) c->data;
+        for (i=0;i<c->numValues;i++) {
+            if (ind[i]>=0) {idx = (unsigned)ind[i];*p++ = palette[idx];}
+            else for (n=(unsigned)(-ind[i]);n>0;--n) *p++ = palette[idx];
+        }
+    }
+    break;
+    case ENCODING_1BPP: {
+        const unsigned char* ind = (const unsigned char*) c->data;
+        const int numBytesPerRow = (c->ep.w+7)/8;
+        int x,y,k,numReps=0;unsigned char b=0;
+        for (y=0;y<c->ep.h;y++) {
+            for (x=0;x<numBytesPerRow;x++) {
+                if (numReps>0) --numReps;
+                else {b = *ind++;if (b==0x00 || b==0xFF) numReps = (int)(*ind++)-1;}
+                for (k=0;k<8 && x*8+k<c->ep.w;k++) *p++ = palette[(b>>(7-k))&1];
+            }
+        }
+    }
+    break;
+    case ENCODING_CHARS_V2: {
+#       define V2_SYMBOL(C) ((unsigned)(C)-33U-((C)>'"')-((C)>':')-((C)>'?')-((C)>'\\'))
+        const unsigned char* pc = (const unsigned char*) c->data;
+        unsigned v,numDirect,mul;
+        numDirect = V2_SYMBOL(pc[1]);pc+=2;     // (after the version)
+        while (*pc!='\0') {
+            v = V2_SYMBOL(*pc);++pc;
+            if (v<numDirect) idx = v;
+            else if (v<CHARS_V2_RUN_SYMBOL) {idx = numDirect+(v-numDirect)*CHARS_V2_NUM_SYMBOLS+V2_SYMBOL(*pc);++pc;}
+            else {
+                n=1;mul=1;
+                do {v = V2_SYMBOL(*pc);++pc;n+=(v>=45?v-45:v)*mul;mul*=45;} while (v>=45);
+                for (;n>0;--n) *p++ = palette[idx];
+                continue;
+            }
+            *p++ = palette[idx];
+        }
+#       undef V2_SYMBOL
+    }
+    break;
+    case ENCODING_INTS_NARROW:
+        if (c->ep.narrowIndexType==NARROW_INDEX_TYPE_U8) DECODE_NARROW_FOR_BENCHMARK(unsigned char)
+        else if (c->ep.narrowIndexType==NARROW_INDEX_TYPE_U16) DECODE_NARROW_FOR_BENCHMARK(unsigned short)
+        else DECODE_NARROW_FOR_BENCHMARK(unsigned int)
+    break;
+    case ENCODING_QUADTREE: {
+        const void* ind = c->data;int x,y;
+        for (y=0;y<c->ep.h;y+=QUADTREE_BLOCK_SIZE) {
+            for (x=0;x<c->ep.w;x+=QUADTREE_BLOCK_SIZE) {
+                if (c->ep.narrowIndexType==NARROW_INDEX_TYPE_U8) ind = DecodeQuadtreeNodeU8ForBenchmark(pixels,c->ep.w,c->ep.h,x,y,QUADTREE_BLOCK_SIZE,palette,numPalette,(const unsigned char*)ind);
+                else ind = DecodeQuadtreeNodeU16ForBenchmark(pixels,c->ep.w,c->ep.h,x,y,QUADTREE_BLOCK_SIZE,palette,numPalette,(const unsigned short*)ind);
+            }
+        }
+        p = pixels+c->ep.w*c->ep.h;
+    }
+    break;
+    default: ASSERT(0);break;
+    }
+    ASSERT(p==pixels+c->ep.w*c->ep.h);
+}
+#undef DECODE_NARROW_FOR_BENCHMARK
+
+// Returns the encoding that is best for 'target' (or -1 if out of memory). 'comment' gets a C comment that records the choice.
+// 'scanOrder' is the order of pIndices: the quadtree mode is a candidate only in row order (it needs the 2D layout of the image).
+static int ChooseEncodingAuto(int target,const unsigned short* pIndices,int scanOrder,const PaletteEntry* palette,const EncoderParams* baseParams,int numThreads,char* comment,FILE* msg) {
+    AutoCandidate candidates[ENCODING_COUNT];
+    AutoJobData jobData;
+    const int area = baseParams->w*baseParams->h, numPaletteColors = baseParams->numPaletteColors;
+    int i,numCandidates=0,best=-1,ok=1;size_t minSize=0;double minMs=0,bestScore=0,scores[ENCODING_COUNT];
+    char* pc = comment;
+
+    for (i=0;i<ENCODING_COUNT;i++) {
+        if (i==ENCODING_PROGRESSIVE || i==ENCODING_SPANS) continue;  // (different use cases)
+        if (i==ENCODING_QUADTREE && scanOrder!=SCAN_ORDER_ROW) continue;
+        if ((i==ENCODING_CHARS && numPaletteColors>76) || (i==ENCODING_1BPP && numPaletteColors>2)) continue;
+        if (numPaletteColors>(i==ENCODING_CHARS_V2 ? CHARS_V2_MAX_COLORS : MAX_NUM_PALETTE_COLORS)) continue;
+        candidates[numCandidates].encoding = i;
+        candidates[numCandidates].ep = *baseParams;
+        candidates[numCandidates].ep.narrowIndexType = i==ENCODING_INTS_NARROW ? ChooseNarrowIndexType(pIndices,area,numPaletteColors) :
+                                                       (i==ENCODING_QUADTREE ? ChooseQuadtreeIndexType(numPaletteColors) : NARROW_INDEX_TYPE_U32);
+        ++numCandidates;
+    }
+    jobData.candidates = candidates;jobData.pIndices = pIndices;
+    ParallelFor(numCandidates,&AutoEncodeJob,&jobData,numThreads);
+    for (i=0;i<numCandidates;i++) ok = ok && candidates[i].data;
+
+    if (ok && target!=AUTO_TARGET_SIZE) {
+        // Decoding times are measured one at a time, on this thread only. The candidates take turns (one decode each per round),
+        // so that a slow moment of the machine does not penalize a single one
+        unsigned* pixels = (unsigned*) malloc((size_t)area*sizeof(unsigned));
+        unsigned benchmarkPalette[CHARS_V2_MAX_COLORS+2];
+        int j,run;double start,t,totalMs;
+        for (j=0;j<numPaletteColors;j++) benchmarkPalette[j] = palette[j].color;
+        benchmarkPalette[numPaletteColors] = benchmarkPalette[0];  // (1bpp with a single color)
+        if (!pixels) ok = 0;
+        for (run=0,totalMs=0;ok && run<AUTO_MAX_NUM_BENCHMARK_RUNS && (run<3 || totalMs<AUTO_MIN_BENCHMARK_MS*numCandidates);run++) {
+            for (i=0;i<numCandidates;i++) {
+                AutoCandidate* c = &candidates[i];
+                start = GetTimeMs();DecodeForBenchmark(pixels,benchmarkPalette,c);t = GetTimeMs()-start;
+                totalMs+=t;if (run==0 || t<c->decodeMs) c->decodeMs = t;
+            }
+        }
+        if (pixels) free(pixels);
+    }
+
+    if (ok) {
+        for (i=0;i<numCandidates;i++) {
+            if (i==0 || candidates[i].dataSize<minSize) minSize = candidates[i].dataSize;
+            if (i==0 || candidates[i].decodeMs<minMs) minMs = candidates[i].decodeMs;
+        }
+        if (minMs<=0) minMs = 0.000001;
+        for (i=0;i<numCandidates;i++) {
+            const AutoCandidate* c = &candidates[i];
+            scores[i] = target==AUTO_TARGET_SIZE ? (double)c->dataSize : (target==AUTO_TARGET_DECODE_SPEED ? c->decodeMs :
+                        (double)c->dataSize/(double)minSize+c->decodeMs/minMs);    // balanced: both relative to the best one
+            if (i==0 || scores[i]<bestScore) bestScore=scores[i];
+        }
+        // Timings change from run to run: the near ties are broken by size (then by encoding), so that the choice is reproducible
+        if (target!=AUTO_TARGET_SIZE) bestScore*=1.0+AUTO_TIE_TOLERANCE;
+        for (i=0;i<numCandidates;i++) {
+            if (scores[i]<=bestScore && (best<0 || candidates[i].dataSize<candidates[best].dataSize)) best=i;
+        }
+        fprintf(msg,"--auto=%s:",autoTargetNames[target]);
+        for (i=0;i<numCandidates;i++) {
+            const AutoCandidate* c = &candidates[i];
+            fprintf(msg," %s%s %lu bytes",i==best ? "[" : "",encodingNames[c->encoding],(unsigned long)c->dataSize);
+            if (target!=AUTO_TARGET_SIZE) fprintf(msg," %.3f ms",c->decodeMs);
+            fprintf(msg,"%s%s",i==best ? "]" : "",i<numCandidates-1 ? "," : "\n");
+        }
+        // The comment has no timings, so that the .inl file only changes when the choice does
+        pc+=sprintf(pc,"/* pngEmbedder --auto=%s chose the %s encoding",autoTargetNames[target],encodingNames[candidates[best].encoding]);
+        if (*encodingOptions[candidates[best].encoding]) pc+=sprintf(pc," (%s)",encodingOptions[candidates[best].encoding]);
+        pc+=sprintf(pc,". Stored bytes:");
+        for (i=0;i<numCandidates;i++) pc+=sprintf(pc," %s %lu%s",encodingNames[candidates[i].encoding],(unsigned long)candidates[i].dataSize,i<numCandidates-1 ? "," : " */\n\n");
+        best = candidates[best].encoding;
+    }
+    for (i=0;i<numCandidates;i++) {if (candidates[i].data) free(candidates[i].data);}
+    return ok ? best : -1;
+}
+
+// --scan: encodes the image in every scan order (concurrently) with 'encoding' and replaces '*ppIndices' with the one that stores the
+// fewest bytes. Returns the scan order (or -1 if out of memory).
+typedef struct {
+    AutoCandidate candidates[SCAN_ORDER_COUNT];
+    unsigned short* reordered[SCAN_ORDER_COUNT];
+} ScanJobData;
+static void ScanEncodeJob(void* userData,int jobIndex) {
+    ScanJobData* d = (ScanJobData*) userData;
+    AutoJobData jobData;
+    jobData.candidates = &d->candidates[jobIndex];jobData.pIndices = d->reordered[jobIndex];
+    AutoEncodeJob(&jobData,0);
+}
+static int ChooseScanOrder(unsigned short** ppIndices,int encoding,const EncoderParams* baseParams,int numThreads,FILE* msg) {
+    ScanJobData d;
+    const int area = baseParams->w*baseParams->h;
+    int i,best=-1,ok=1;
+    for (i=0;i<SCAN_ORDER_COUNT;i++) {
+        d.reordered[i] = i==SCAN_ORDER_ROW ? *ppIndices : ReorderToScanOrder(*ppIndices,baseParams->w,baseParams->h,i);
+        d.candidates[i].encoding = encoding;d.candidates[i].ep = *baseParams;d.candidates[i].data = NULL;
+        if (!d.reordered[i]) {ok=0;continue;}
+        if (encoding==ENCODING_INTS_NARROW) d.candidates[i].ep.narrowIndexType = ChooseNarrowIndexType(d.reordered[i],area,baseParams->numPaletteColors);
+    }
+    if (ok) ParallelFor(SCAN_ORDER_COUNT,&ScanEncodeJob,&d,numThreads);
+    for (i=0;ok && i<SCAN_ORDER_COUNT;i++) ok = d.candidates[i].data!=NULL;
+    if (ok) {
+        for (i=0;i<SCAN_ORDER_COUNT;i++) {if (best<0 || d.candidates[i].dataSize<d.candidates[best].dataSize) best=i;}
+        fprintf(msg,"--scan:");
+        for (i=0;i<SCAN_ORDER_COUNT;i++) fprintf(msg," %s%s %lu bytes%s%s",i==best ? "[" : "",scanOrderNames[i],(unsigned long)d.candidates[i].dataSize,i==best ? "]" : "",i<SCAN_ORDER_COUNT-1 ? "," : "\n");
+        *ppIndices = d.reordered[best];
+    }
+    for (i=0;i<SCAN_ORDER_COUNT;i++) {
+        if (d.candidates[i].data) free(d.candidates[i].data);
+        if (d.reordered[i] && d.reordered[i]!=*ppIndices) free(d.reordered[i]);  // (the row-major one too, if it did not win)
+    }
+    return ok ? best : -1;
+}
+
+
+// --variant: loads every variant image and matches it to 'pIndices' (see MatchPaletteVariant(...)). Returns a malloc'ed array with
+// numPaletteColors+1 colors for each variant, or NULL (after printing the error)
+static unsigned* LoadPaletteVariants(const char** paths,int numVariants,int w,int h,const PaletteEntry* palette,int numPaletteColors,const unsigned short* pIndices,FILE* msg) {
+    const int stride = numPaletteColors+1;
+    unsigned* variantColors = (unsigned*) malloc((size_t)numVariants*stride*sizeof(unsigned));
+    int k,vw=0,vh=0,vc=0,mismatch=-1,ok=1;
+    if (!variantColors) {fprintf(msg,"Error: out of memory.\n");return NULL;}
+    for (k=0;ok && k<numVariants;k++) {
+        InputFile input;unsigned char* raw = NULL;
+        if (InputFileOpen(&input,paths[k])) {
+            raw = stbi_load_from_memory(input.data,(int)input.size,&vw,&vh,&vc,4);
+            InputFileClose(&input);
+        }
+        if (!raw) {fprintf(msg,"Filename \"%s\" invalid (not found or invalid image file).\n",paths[k]);ok=0;}
+        else if (vw!=w || vh!=h) {fprintf(msg,"Error: \"%s\" is %dx%d, not %dx%d.\n",paths[k],vw,vh,w,h);ok=0;}
+        else if (!MatchPaletteVariant(&variantColors[k*stride],palette,numPaletteColors,pIndices,(const unsigned*) raw,w*h,&mismatch)) {
+            if (mismatch<0) fprintf(msg,"Error: out of memory.\n");
+            else fprintf(msg,"Error: \"%s\" does not have the same index structure: pixel (%d,%d) needs a second color for the same palette index.\n",paths[k],mismatch%w,mismatch/w);
+            ok=0;
+        }
+        if (raw) {STBI_FREE(raw);raw=NULL;}
+    }
+    if (!ok) {free(variantColors);variantColors=NULL;}
+    return variantColors;
+}
+
+
+int main(int argc,char* argv[]) {
+    const char* filename = NULL;
+    char savename[2049] = "";
+    int i,j;FILE* f = NULL;
+    const int numCharsPerLine = 800;int numChars=0;
+    int flipOptionUsed = 0, flipY = 0;
+    int numThreads = GetNumHardwareThreads();
+    int singleChannelOptionUsed = 0, pixelFormat = PIXEL_FORMAT_RGBA;
+    int oneBppOptionUsed = 0, v2OptionUsed = 0, narrowOptionUsed = 0, encoding = ENCODING_CHARS;
+    int scanOptionUsed = 0, scanOrder = SCAN_ORDER_ROW, quadtreeOptionUsed = 0, spansOptionUsed = 0, rectOutputOptionUsed = 0, specializeOptionUsed = 0;
+    const char* variantPaths[MAX_NUM_PALETTE_VARIANTS];int numVariants = 0, variantStride = 0;unsigned* variantColors = NULL;
+    const char* tracePath = NULL;int statsOptionUsed = 0, span = -1;long bytesIn = 0, bytesOut = 0;
+    const char* outputPath = NULL;FILE* msg = stdout;  // messages go to stderr when the .inl file goes to stdout
+    int trimOptionUsed = 0, trimX = 0, trimY = 0, originalWidth = 0, originalHeight = 0;
+    int tileSize = 0, tileFlipsOptionUsed = 0;Tileset tileset = {0,0,0,0,NULL};
+    int blockFormat = BLOCK_FORMAT_NONE, indexOutputOptionUsed = 0, progressiveOptionUsed = 0;
+    int intsOptionUsed = 0, autoTarget = AUTO_TARGET_NONE;char autoComment[512] = "";
+
+    {
+        int badOption = 0;
+        for (i=1;i<argc;i++) {
+            const char* arg = argv[i];
+            if (strcmp(arg,"-f")==0) flipOptionUsed = 1;
+            else if (strncmp(arg,"--threads=",10)==0) {numThreads = atoi(&arg[10]);if (numThreads<1) badOption=1;}
+            else if (strcmp(arg,"--8bit")==0) singleChannelOptionUsed = 1;
+            else if (strcmp(arg,"--1bpp")==0) oneBppOptionUsed = 1;
+            else if (strcmp(arg,"--v2")==0) v2OptionUsed = 1;
+            else if (strcmp(arg,"--narrow")==0) narrowOptionUsed = 1;
+            else if (strcmp(arg,"--ints")==0) intsOptionUsed = 1;
+            else if (strcmp(arg,"--quadtree")==0) quadtreeOptionUsed = 1;
+            else if (strcmp(arg,"--spans")==0) spansOptionUsed = 1;
+            else if (strncmp(arg,"--variant=",10)==0 || (strcmp(arg,"--variant")==0 && i+1<argc)) {
+                if (numVariants<MAX_NUM_PALETTE_VARIANTS) variantPaths[numVariants++] = arg[9]=='=' ? &arg[10] : argv[++i];
+                else badOption = 1;
+            }
+            else if (strncmp(arg,"--auto=",7)==0) {
+                for (autoTarget=AUTO_TARGET_COUNT-1;autoTarget>AUTO_TARGET_NONE;--autoTarget) {if (strcmp(&arg[7],autoTargetNames[autoTarget])==0) break;}
+                if (autoTarget==AUTO_TARGET_NONE) badOption = 1;
+            }
+            else if (strcmp(arg,"--stats")==0) statsOptionUsed = 1;
+            else if (strcmp(arg,"--trace")==0 && i+1<argc) tracePath = argv[++i];
+            else if (strncmp(arg,"--trace=",8)==0) tracePath = &arg[8];
+            else if (strcmp(arg,"-o")==0 && i+1<argc) outputPath = argv[++i];
+            else if (strcmp(arg,"--trim")==0) trimOptionUsed = 1;
+            else if (strncmp(arg,"--tiles=",8)==0) {tileSize = atoi(&arg[8]);if (tileSize!=8 && tileSize!=16 && tileSize!=32) badOption = 1;}
+            else if (strcmp(arg,"--tile-flips")==0) tileFlipsOptionUsed = 1;
+            else if (strcmp(arg,"--bc1")==0) blockFormat = BLOCK_FORMAT_BC1;
+            else if (strcmp(arg,"--bc3")==0) blockFormat = BLOCK_FORMAT_BC3;
+            else if (strcmp(arg,"--etc2")==0) blockFormat = BLOCK_FORMAT_ETC2;
+            else if (strcmp(arg,"--index-output")==0) indexOutputOptionUsed = 1;
+            else if (strcmp(arg,"--rect-output")==0) rectOutputOptionUsed = 1;
+            else if (strcmp(arg,"--specialize")==0) specializeOptionUsed = 1;
+            else if (strcmp(arg,"--progressive")==0) progressiveOptionUsed = 1;
+            else if (strcmp(arg,"--scan")==0) {scanOptionUsed = 1;scanOrder = -1;}
+            else if (strncmp(arg,"--scan=",7)==0) {
+                for (scanOrder=SCAN_ORDER_COUNT-1;scanOrder>=0;--scanOrder) {if (strcmp(&arg[7],scanOrderNames[scanOrder])==0) break;}
+                if (scanOrder<0) badOption = 1;
+                scanOptionUsed = 1;
+            }
+            else if ((arg[0]=='-' && arg[1]!='\0') || filename) badOption = 1;
+            else filename = arg;
+        }
+        if (badOption || !filename) {
+            printf("pngEmbedder embeds a paletted png into C/C++ source code.\n");
+            printf("USAGE: pngEmbedder [options] inputFile.png\n");
+            printf("OPTIONS:\n");
+            printf("  -f             flip the image vertically\n");
+            printf("  --trim         merge all the fully transparent colors and crop fully transparent borders\n");
+            printf("  --tiles=N      store the unique NxN tiles (N = 8, 16 or 32) and a tilemap\n");
+            printf("  --tile-flips   with --tiles, also reuse flipped or rotated tiles\n");
+            printf("  --bc1, --bc3, --etc2  save a block compressed texture (that can be uploaded to the GPU as-is) instead of palette and indices\n");
+            printf("  -o out.inl     output file (default: inputFile.png.inl). Use - for stdout (and - as inputFile for stdin)\n");
+            printf("  --threads=N    number of worker threads (default: %d)\n",GetNumHardwareThreads());
+            printf("  --8bit         use an 8-bit palette for gray images and alpha masks (R8/A8 output)\n");
+            printf("  --1bpp         use 1 bit per pixel for two-color images (masks, bitmap fonts)\n");
+            printf("  --v2           use the char mode v2 (up to %d colors, shorter runs)\n",CHARS_V2_MAX_COLORS);
+            printf("  --ints         use the int mode even with few colors\n");
+            printf("  --narrow       use the int mode with the smallest index type (unsigned char/short/int)\n");
+            printf("  --quadtree     store a quadtree of uniform squares (for flat images with large single-color areas)\n");
+            printf("  --spans        store the spans of non-transparent pixels of each row, for BlitSprite(...) (sprites)\n");
+            printf("  --auto=T       try all the encodings above and keep the best one for T = size, decode-speed or balanced\n");
+            printf("  --progressive  store the indices in 7 coarse-to-fine passes, so that the image can be shown while it is decoded\n");
+            printf("  --scan         store the pixels in the scan order that takes fewer bytes: row, column, serpentine or hilbert\n");
+            printf("                 (decoding a non-row order needs a temporary width*height buffer and an UnscanImage(...) pass)\n");
+            printf("  --scan=S       store the pixels in the scan order S (one of the above)\n");
+            printf("  --index-output also add decoders that write palette indices (R8/R16 index textures for shader-side palette lookup)\n");
+            printf("  --rect-output  also add decoders that write a clip rectangle into a larger image (with a row stride, e.g. a texture atlas)\n");
+            printf("  --specialize   also add a decoder specialized for this image (char and int modes): sizes and run lengths become constants\n");
+            printf("  --variant v.png  add the palette of v.png, a recolored version of inputFile.png (the indices are shared, up to %d times)\n",MAX_NUM_PALETTE_VARIANTS);
+            printf("  --stats        print the time of each phase, bytes in and out and peak memory usage (also on errors)\n");
+            printf("  --trace out.json  save the phase timings as Chrome trace-event JSON\n");
+            printf("Tip: use: pngnq -n 75 inputFile.png\n");
+            printf("to get a suitable paletted image.\n");
+            return -1;
+        }
+#       ifndef INVERT_FLIPY_DEFAULT
+        flipY = flipOptionUsed;
+#       else
+        flipY = !flipOptionUsed;
+#       endif
+        stbi_set_flip_vertically_on_load(flipY);
+
+        if (!outputPath && strcmp(filename,"-")==0) outputPath = "-";
+        if (outputPath) {
+            if (strlen(outputPath)>=2048) {
+                printf("Error output file path is too long.\n");
+                return -1;
+            }
+            strcpy(savename,outputPath);
+        }
+        else {
+            if (strlen(filename)+4>=2048) {
+                printf("Error input file path is too long.\n");
+                return -1;
+            }
+            strcpy(savename,filename);
+            strcat(savename,".inl");
+        }
+        if (strcmp(savename,"-")==0) msg = stderr;
+    }
+
+#   ifdef NEVER
+    const int numVarNames = 26 /* A-Z */ + 24 /* a-z without i,j */ + 52 * (26*2+10);   // = 3274
+    char varNames[numVarNames][3];
+    {
+        int cnt=0;
+        for (i=0;i<26;i++) {varNames[cnt][0]=(char)(i+'A');varNames[cnt++][1]='\0';}
+        for (i=0;i<26;i++) {
+            if ((char)(i+'a') == 'i' || (char)(i+'a')=='j') continue;
+            varNames[cnt][0]=(char)(i+'a');
+            varNames[cnt++][1]='\0';
+        }
+        for (i=0;i<52;i++) {
+            for (j=0;j<62;j++) {
+                varNames[cnt][0]=(char)(i<26?(i+'A'):(i-26+'a'));
+                varNames[cnt][1]=(char)(j<26?(j+'A'):(j<52?(j-26+'a'):(j-52+'0')));
+                varNames[cnt++][2]='\0';
+            }
+        }
+        ASSERT(cnt==numVarNames);
+        //for (i=0;i<numVarNames;i++) printf("%d)\t\"%s\"\n",i,varNames[i]);
+    }
+#   endif //NEVER
+
+    if (numVariants>0 && (trimOptionUsed || tileSize>0 || blockFormat!=BLOCK_FORMAT_NONE)) {
+        fprintf(msg,"Palette variants need the whole image: --variant ignored with --trim, --tiles and block compression.\n");
+        numVariants = 0;
+    }
+
+    int w=0,h=0,c=0,area=0,ret=0;
+    InputFile input;unsigned char* raw = NULL;
+    PalettedImage paletted;paletted.indices = NULL;
+    unsigned char* blocks = NULL;
+    PaletteEntry paletteEntries[MAX_NUM_PALETTE_COLORS+2];
+    PaletteEntry* palette = paletteEntries;     // (on the heap when --v2 or --auto can use up to CHARS_V2_MAX_COLORS colors)
+    int numPaletteColors = 0;
+    unsigned short* pIndices = NULL;
+    span = TraceBegin("load");
+    if (InputFileOpen(&input,filename)) {
+        bytesIn = (long) input.size;
+        // Paletted PNGs skip the RGBA expansion (--trim, --tiles and block compression work on RGBA pixels)
+        if (!trimOptionUsed && tileSize==0 && blockFormat==BLOCK_FORMAT_NONE && LoadPalettedPng(&paletted,input.data,input.size,flipY)) {w=paletted.w;h=paletted.h;c=4;}
+        else raw = stbi_load_from_memory(input.data,(int)input.size,&w,&h,&c,4);
+        InputFileClose(&input);
+    }
+    TraceEnd(span);
+    {
+        if (!raw && !paletted.indices) {
+            fprintf(msg,"Filename \"%s\" invalid (not found or invalid image file).\n",filename);
+            ret = -2;goto cleanup;
+        }
+        if (c!=4) fprintf(msg,"Converting \"%s\" to RGBA (the only supported number of channels).\n",filename);
+        area=w*h;
+        originalWidth=w;originalHeight=h;
+        if (trimOptionUsed) {
+            span = TraceBegin("trim");
+            area = TrimTransparentPixels((unsigned*) raw,&w,&h,&trimX,&trimY);
+            TraceEnd(span);
+        }
+        if (tileSize>0) {
+            if (w%tileSize!=0 || h%tileSize!=0) {
+                fprintf(msg,"Error: the image size (%dx%d) is not a multiple of the tile size (%d).\n",w,h,tileSize);
+                ret = -3;goto cleanup;
+            }
+            span = TraceBegin("tiles");
+            if (!BuildTileset(&tileset,(unsigned*) raw,&w,&h,tileSize,tileFlipsOptionUsed)) {
+                TraceEnd(span);
+                fprintf(msg,"Error: out of memory or more than %d unique tiles.\n",TILEMAP_MAX_NUM_TILES);
+                ret = -3;goto cleanup;
+            }
+            TraceEnd(span);
+            area=w*h;
+            fprintf(msg,"%d unique tiles out of %d.\n",tileset.numTiles,tileset.tilemapWidth*tileset.tilemapHeight);
+        }
+    }
+
+    if (blockFormat!=BLOCK_FORMAT_NONE) {
+        const int numBlocksX = (w+3)/4, numBlocksY = (h+3)/4;
+        int numBytes;
+        if (singleChannelOptionUsed) fprintf(msg,"Block compressed textures are RGBA: --8bit ignored.\n");
+        if (indexOutputOptionUsed) fprintf(msg,"Block compressed textures have no palette: --index-output ignored.\n");
+        if (rectOutputOptionUsed) fprintf(msg,"Block compressed textures are stored in blocks: --rect-output ignored.\n");
+        if (specializeOptionUsed) fprintf(msg,"Block compressed textures have no indices: --specialize ignored.\n");
+        if (blockFormat==BLOCK_FORMAT_ETC2) {   // ETC2 RGB, or ETC2 RGBA if some pixel is not opaque
+            for (i=0;i<area && (((const unsigned*) raw)[i]>>24)==255;i++) {}
+            if (i<area) blockFormat = BLOCK_FORMAT_ETC2_EAC;
+        }
+        numBytes = numBlocksX*numBlocksY*blockFormatSizes[blockFormat];
+        span = TraceBegin("compress");
+        blocks = CompressBlocks((const unsigned*) raw,w,h,blockFormat,numThreads);
+        TraceEnd(span);
+        if (!blocks) {
+            fprintf(msg,"Error: out of memory.\n");
+            ret = -4;goto cleanup;
+        }
+        span = TraceBegin("emit");
+        f = strcmp(savename,"-")==0 ? stdout : fopen(savename,"wt");
+        if (!f) {
+            fprintf(msg,"Error: cannot save file: \"%s\".\n",savename);
+            ret = -5;goto cleanup;
+        }
+        WriteImageHeader(f,w,h,trimOptionUsed,trimX,trimY,originalWidth,originalHeight,&tileset,numCharsPerLine);
+        OutPrintf(f,"/* %s */\n",blockFormatDescriptions[blockFormat]);
+        OutPrintf(f,"/* %dx%d blocks of 4x4 pixels (in row-major order, %d bytes each) */\n",numBlocksX,numBlocksY,blockFormatSizes[blockFormat]);
+        OutPrintf(f,"const unsigned char blocks[%d] = {\n",numBytes);
+        numChars = 0;
+        for (j=0;j<numBytes;j++) {
+            numChars+=OutPrintf(f,j<numBytes-1 ? "%u," : "%u",(unsigned)blocks[j]);
+            if (numChars>=numCharsPerLine) {OutPrintf(f,"\n");numChars=0;}
+        }
+        OutPrintf(f,"\n};\n\n");
+#       ifndef NO_USAGE_IN_INL_FILES
+        OutPrintf(f,"#ifdef USAGE\n");
+        WriteUsage(f,*blockFormatUsages[blockFormat][0],"","","");
+        WriteUsage(f,*blockFormatUsages[blockFormat][1],"","","");
+        if (tileset.tilemap) WriteUsage(f,*expandTilemapUsage,"unsigned","","");
+        OutPrintf(f,"\n#endif //USAGE\n\n");
+#       endif
+        bytesOut = numBytesOut;
+        if (f!=stdout) fclose(f);
+        else fflush(f);
+        f=NULL;
+        TraceEnd(span);
+        goto cleanup;
+    }
+
+    if (autoTarget!=AUTO_TARGET_NONE || (v2OptionUsed && !narrowOptionUsed && !quadtreeOptionUsed && !spansOptionUsed && !progressiveOptionUsed)) {
+        palette = (PaletteEntry*) malloc((CHARS_V2_MAX_COLORS+2)*sizeof(PaletteEntry));
+        if (!palette) {
+            fprintf(msg,"Error: out of memory.\n");
+            ret = -4;goto cleanup;
+        }
+    }
+    if (paletted.indices) {
+        span = TraceBegin("histogram");
+        numPaletteColors = BuildPaletteFromIndices(palette,&paletted);
+        TraceEnd(span);
+    }
+    else numPaletteColors = BuildSortedPalette(palette,palette!=paletteEntries ? CHARS_V2_MAX_COLORS : MAX_NUM_PALETTE_COLORS,(const unsigned int*) raw,area,numThreads);
+    if (numPaletteColors<0) {
+        fprintf(msg,"Error: Too many colors in input image. Please use pngnq to reduce them.\n");
+        ret = -3;goto cleanup;
+    }
+    /*for (j=0;j<numPaletteColors;j++) {
+        PaletteEntry* pe = &palette[j];
+        printf("palette[%d] = %uU (reps=%lu)\n",j,pe->color,pe->reps);
+    }*/
+
+    if (numPaletteColors==0) {
+        fprintf(msg,"Error: numPaletteColors==0.\n");
+        ret = -4;goto cleanup;
+    }
+
+    if (autoTarget!=AUTO_TARGET_NONE && (intsOptionUsed || v2OptionUsed || oneBppOptionUsed || narrowOptionUsed || quadtreeOptionUsed || spansOptionUsed || progressiveOptionUsed)) {
+        fprintf(msg,"--auto chooses the encoding: --ints, --1bpp, --v2, --narrow, --quadtree, --spans and --progressive ignored.\n");
+        intsOptionUsed = v2OptionUsed = oneBppOptionUsed = narrowOptionUsed = quadtreeOptionUsed = spansOptionUsed = progressiveOptionUsed = 0;
+    }
+    encoding = (numPaletteColors>76 || intsOptionUsed) ? ENCODING_INTS : ENCODING_CHARS;
+    if (v2OptionUsed) encoding = ENCODING_CHARS_V2;   // (numPaletteColors<=CHARS_V2_MAX_COLORS here)
+    if (narrowOptionUsed) encoding = ENCODING_INTS_NARROW;
+    if (quadtreeOptionUsed) encoding = ENCODING_QUADTREE;
+    if (spansOptionUsed) encoding = ENCODING_SPANS;
+    if (progressiveOptionUsed) {
+        if (v2OptionUsed || oneBppOptionUsed || quadtreeOptionUsed || spansOptionUsed) fprintf(msg,"--progressive uses the narrow int mode: --v2, --1bpp, --quadtree and --spans ignored.\n");
+        encoding = ENCODING_PROGRESSIVE;oneBppOptionUsed = 0;
+    }
+    if (oneBppOptionUsed) {
+        if (numPaletteColors>2) fprintf(msg,"\"%s\" has more than 2 colors: 1bpp mode ignored.\n",filename);
+        else if (spansOptionUsed) fprintf(msg,"--spans and --1bpp are different modes: --1bpp ignored.\n");
+        else {
+            encoding = ENCODING_1BPP;
+            if (numPaletteColors==1) {palette[1]=palette[0];palette[1].reps=0;numPaletteColors=2;}  // the decoder needs 2 colors
+        }
+    }
+
+    span = TraceBegin("remap");
+    if (paletted.indices) {
+        pIndices = RemapPalettedIndices(&paletted);
+        free(paletted.indices);paletted.indices=NULL;
+    }
+    else pIndices = RemapToPaletteIndices(palette,numPaletteColors,(const unsigned int*) raw,area,numThreads);
+    TraceEnd(span);
+    if (pIndices && numVariants>0) {
+        span = TraceBegin("variants");
+        variantColors = LoadPaletteVariants(variantPaths,numVariants,w,h,palette,numPaletteColors,pIndices,msg);
+        variantStride = numPaletteColors+1;
+        TraceEnd(span);
+        if (!variantColors) {
+            ret = -3;goto cleanup;
+        }
+        fprintf(msg,"%d palette variants share the indices of \"%s\".\n",numVariants,filename);
+    }
+    if (pIndices && encoding==ENCODING_PROGRESSIVE) {
+        unsigned short* pReordered = ReorderToProgressive(pIndices,w,h);
+        free(pIndices);pIndices = pReordered;
+    }
+    if (!pIndices) {
+        fprintf(msg,"Error: out of memory.\n");
+        ret = -4;goto cleanup;
+    }
+
+    if (scanOptionUsed && (encoding==ENCODING_PROGRESSIVE || encoding==ENCODING_QUADTREE || encoding==ENCODING_SPANS)) {
+        fprintf(msg,"%s has its own order: --scan ignored.\n",encodingOptions[encoding]);
+        scanOptionUsed = 0;scanOrder = SCAN_ORDER_ROW;
+    }
+    if (scanOptionUsed) {
+        // (with --auto, the scan order is chosen first, with the default encoding)
+        EncoderParams ep;
+        ep.w=w;ep.h=h;ep.numPaletteColors=numPaletteColors;ep.numCharsPerLine=numCharsPerLine;ep.narrowIndexType=NARROW_INDEX_TYPE_U32;ep.transparentIndices=NULL;
+        span = TraceBegin("scan");
+        if (scanOrder<0) scanOrder = ChooseScanOrder(&pIndices,encoding,&ep,numThreads,msg);
+        else if (scanOrder!=SCAN_ORDER_ROW) {
+            unsigned short* pReordered = ReorderToScanOrder(pIndices,w,h,scanOrder);
+            if (!pReordered) scanOrder = -1;
+            else {free(pIndices);pIndices = pReordered;}
+        }
+        TraceEnd(span);
+        if (scanOrder<0) {
+            fprintf(msg,"Error: out of memory.\n");
+            ret = -4;goto cleanup;
+        }
+    }
+
+    if (autoTarget!=AUTO_TARGET_NONE) {
+        EncoderParams ep;
+        ep.w=w;ep.h=h;ep.numPaletteColors=numPaletteColors;ep.numCharsPerLine=numCharsPerLine;ep.narrowIndexType=NARROW_INDEX_TYPE_U32;ep.transparentIndices=NULL;
+        span = TraceBegin("auto");
+        encoding = ChooseEncodingAuto(autoTarget,pIndices,scanOrder,palette,&ep,numThreads,autoComment,msg);
+        TraceEnd(span);
+        if (encoding<0) {
+            fprintf(msg,"Error: out of memory.\n");
+            ret = -4;goto cleanup;
+        }
+        if (encoding==ENCODING_1BPP && numPaletteColors==1) {palette[1]=palette[0];palette[1].reps=0;numPaletteColors=2;}  // the decoder needs 2 colors
+    }
+
+    span = TraceBegin("emit");
+    f = strcmp(savename,"-")==0 ? stdout : fopen(savename,"wt");
+    if (!f) {
+        fprintf(msg,"Error: cannot save file: \"%s\".\n",savename);
+        ret = -5;goto cleanup;
+    }
+
+    // Write image dimensions
+    OutPrintf(f,"%s",autoComment);
+    WriteImageHeader(f,w,h,trimOptionUsed,trimX,trimY,originalWidth,originalHeight,&tileset,numCharsPerLine);
+    if (scanOptionUsed) {
+        OutPrintf(f,"/* The pixels are stored in %s order%s */\n",scanOrderDescriptions[scanOrder],scanOrder!=SCAN_ORDER_ROW ? ": the decoders write them in this order, then UnscanImage(...) puts them back in rows" : "");
+        OutPrintf(f,"const int scanOrder = %d;    /* 0 = row, 1 = column, 2 = serpentine, 3 = hilbert (--scan=...) */\n\n",scanOrder);
+    }
+
+    // Write Palette Here
+    if (singleChannelOptionUsed) {
+        pixelFormat = DetectSingleChannelPixelFormat(palette,numPaletteColors);
+        for (j=0;variantColors && pixelFormat!=PIXEL_FORMAT_RGBA && j<numVariants*variantStride;j++) {
+            const unsigned color = variantColors[j];   // (the variants must be of the same kind, with the same RGB for alpha masks)
+            if (pixelFormat==PIXEL_FORMAT_R8 ? ((color>>24)!=255 || (color&0xFF)!=((color>>8)&0xFF) || (color&0xFF)!=((color>>16)&0xFF)) :
+                                               ((color&0x00FFFFFF)!=(palette[0].color&0x00FFFFFF))) pixelFormat = PIXEL_FORMAT_RGBA;
+        }
+        if (pixelFormat==PIXEL_FORMAT_RGBA) fprintf(msg,"\"%s\"%s is not a gray image or an alpha mask: using the RGBA palette.\n",filename,variantColors ? " (or one of its variants)" : "");
+    }
+    numChars = 0;
+    if (pixelFormat!=PIXEL_FORMAT_RGBA) {
+        if (pixelFormat==PIXEL_FORMAT_R8) OutPrintf(f,"/* 8-bit gray palette (R8 output, with R=G=B and A=255 in the original image) */\n");
+        else {
+            OutPrintf(f,"/* RGB shared by all the pixels (little-endian encoding, alpha is zero) */\n");
+            OutPrintf(f,"const unsigned int paletteRGB = %uU;\n\n",palette[0].color&0x00FFFFFF);
+            OutPrintf(f,"/* 8-bit alpha palette (A8 output, RGB is 'paletteRGB' in the original image) */\n");
+        }
+        OutPrintf(f,"const unsigned char palette[%d] = {\n",numPaletteColors);
+    }
+    else {
+        OutPrintf(f,"/* RGBA palette in little-endian encoding */\n");
+        OutPrintf(f,"unsigned int palette[%d] = {\n",numPaletteColors);
+    }
+    for (j=0;j<numPaletteColors;j++) {
+        PaletteEntry* pe = &palette[j];
+        if (pixelFormat!=PIXEL_FORMAT_RGBA) {
+            const unsigned char v = GetSingleChannelValue(pe->color,pixelFormat);
+            OutPrintf(f,"%u",(unsigned)v);numChars+=v<10?1:(v<100?2:3);
+        }
+        else {OutPrintf(f,"%uU",pe->color);numChars+=pe->color==0?2:11;}
+        if (j<numPaletteColors-1) {OutPrintf(f,",");++numChars;}
+        if (numChars>=numCharsPerLine) {OutPrintf(f,"\n");numChars=0;}
+    }
+    OutPrintf(f,"};\n\n");
+    if (variantColors) {
+        int k;
+        OutPrintf(f,"/* Palette variants (the same indices with other colors):");
+        for (k=0;k<numVariants;k++) OutPrintf(f," %d = \"%s\"%s",k,variantPaths[k],k<numVariants-1 ? "," : ".");
+        OutPrintf(f," Pass paletteVariants[k] to the decoders instead of 'palette' */\n");
+        OutPrintf(f,pixelFormat!=PIXEL_FORMAT_RGBA ? "const unsigned char paletteVariants[%d][%d] = {\n" : "unsigned int paletteVariants[%d][%d] = {\n",numVariants,numPaletteColors);
+        for (k=0;k<numVariants;k++) {
+            OutPrintf(f,"{");numChars=1;
+            for (j=0;j<numPaletteColors;j++) {
+                const unsigned color = variantColors[k*variantStride+j];
+                if (pixelFormat!=PIXEL_FORMAT_RGBA) numChars+=OutPrintf(f,"%u",(unsigned)GetSingleChannelValue(color,pixelFormat));
+                else numChars+=OutPrintf(f,"%uU",color);
+                if (j<numPaletteColors-1) {OutPrintf(f,",");++numChars;}
+                if (numChars>=numCharsPerLine) {OutPrintf(f,"\n");numChars=0;}
+            }
+            OutPrintf(f,k<numVariants-1 ? "},\n" : "}\n");
+        }
+        OutPrintf(f,"};\n\n");
+    }
+
+    // Write indices here
+    {
+        const EncodingInfo* ei = &encodingInfos[encoding];
+        OutBuffer out = {NULL,0,0,0};int ok;
+        EncoderParams ep;unsigned char transparentIndices[CHARS_V2_MAX_COLORS+2];
+        const char* outputIndexType = numPaletteColors<=256 ? "unsigned char" : "unsigned short";
+        const int swapsPaletteBE = pixelFormat==PIXEL_FORMAT_RGBA && ((encoding!=ENCODING_CHARS && encoding!=ENCODING_INTS) || (rectOutputOptionUsed && ei->usageRect) || specializeOptionUsed);   // (DecodeImage and DecodeImageInt swap 'palette' itself)
+        ep.w=w;ep.h=h;ep.numPaletteColors=numPaletteColors;ep.numCharsPerLine=numCharsPerLine;
+        ep.narrowIndexType = (encoding==ENCODING_INTS_NARROW || encoding==ENCODING_PROGRESSIVE) ? ChooseNarrowIndexType(pIndices,area,numPaletteColors) :
+                             (encoding==ENCODING_QUADTREE ? ChooseQuadtreeIndexType(numPaletteColors) :
+                             (encoding==ENCODING_SPANS ? ChooseSpansIndexType(w,numPaletteColors) : NARROW_INDEX_TYPE_U32));
+        for (j=0;j<numPaletteColors;j++) {
+            // (with --variant, an index is left out of the spans only if it's transparent in every palette)
+            int k;transparentIndices[j] = (unsigned char) ((palette[j].color>>24)==0);
+            for (k=0;k<numVariants && variantColors && transparentIndices[j];k++) transparentIndices[j] = (unsigned char) ((variantColors[k*variantStride+j]>>24)==0);
+        }
+        ep.transparentIndices = transparentIndices;
+        OutPrintf(f,ei->declaration,w,h,narrowIndexTypeNames[ep.narrowIndexType]);
+        ok = EncodeStripes(&out,ei->encoder,ei->stripeSeparator,pIndices,&ep,numThreads);
+        if (ok) OutWrite(out.data,out.size,f);
+        OutBufferFree(&out);
+        if (!ok) {
+            fprintf(msg,"Error: out of memory.\n");
+            ret = -4;goto cleanup;
+        }
+        OutPrintf(f,"%s",ei->closing);
+
+#       ifndef NO_USAGE_IN_INL_FILES
+        OutPrintf(f,"#ifdef USAGE\n");
+        if (swapsPaletteBE) {
+            OutPrintf(f,"/* Define USE_BIG_ENDIAN_MACHINE on big endian machines: the decoders below then read the palette through a byte-swapped local copy */\n");
+            OutPrintf(f,"#ifdef USE_BIG_ENDIAN_MACHINE\n#define PALETTE_BE_SIZE %d   /* the size of 'palette' */\n",numPaletteColors);
+            WriteUsage(f,*swapPaletteBEUsage,"","","");
+        }
+        WriteUsage(f,pixelFormat!=PIXEL_FORMAT_RGBA ? *ei->usage8 : *ei->usage,narrowIndexTypeNames[ep.narrowIndexType],narrowIndexTypeSuffixes[ep.narrowIndexType],outputIndexType);
+        if (specializeOptionUsed && !WriteSpecializedDecoder(f,encoding,pIndices,&ep,pixelFormat)) fprintf(msg,"There is no specialized decoder for the %s mode: --specialize ignored.\n",encodingNames[encoding]);
+        if (unscanUsages[scanOrder]) WriteUsage(f,*unscanUsages[scanOrder],pixelFormat!=PIXEL_FORMAT_RGBA ? "unsigned char" : "unsigned",pixelFormat!=PIXEL_FORMAT_RGBA ? "8" : "","");
+        if (tileset.tilemap) WriteUsage(f,*expandTilemapUsage,pixelFormat!=PIXEL_FORMAT_RGBA ? "unsigned char" : "unsigned",pixelFormat!=PIXEL_FORMAT_RGBA ? "8" : "","");
+        if (indexOutputOptionUsed && !ei->usageIndices) fprintf(msg,"There are no index-only decoders for the %s mode: --index-output ignored.\n",encodingNames[encoding]);
+        else if (indexOutputOptionUsed) {
+            OutPrintf(f,"\n/* Index-only decoding: upload the indices as an R8 or R16 texture and 'palette' as a separate lookup texture,\n");
+            OutPrintf(f,"   so that palette swaps and color cycling only need to update the palette */\n");
+            WriteUsage(f,*ei->usageIndices,narrowIndexTypeNames[ep.narrowIndexType],narrowIndexTypeSuffixes[ep.narrowIndexType],outputIndexType);
+            if (!(pixelFormat!=PIXEL_FORMAT_RGBA && numPaletteColors<=256)) {   // (UnscanImage8 and ExpandTilemap8 are already there)
+                if (unscanUsages[scanOrder]) WriteUsage(f,*unscanUsages[scanOrder],outputIndexType,numPaletteColors<=256 ? "8" : "16","");
+                if (tileset.tilemap) WriteUsage(f,*expandTilemapUsage,outputIndexType,numPaletteColors<=256 ? "8" : "16","");
+            }
+        }
+        if (rectOutputOptionUsed) {
+            const char* pixelType = pixelFormat!=PIXEL_FORMAT_RGBA ? "unsigned char" : "unsigned";
+            if (encoding==ENCODING_SPANS) fprintf(msg,"BlitSprite(...) already writes into a larger image: --rect-output ignored.\n");
+            else if (!ei->usageRect) fprintf(msg,"There are no clip rectangle decoders for the %s mode: --rect-output ignored.\n",encodingNames[encoding]);
+            else if (scanOrder!=SCAN_ORDER_ROW) fprintf(msg,"Clip rectangle decoders need the row order: --rect-output ignored.\n");
+            else {
+                OutPrintf(f,"\n");
+                WriteRectUsage(f,*decodeRectUsage,narrowIndexTypeNames[ep.narrowIndexType],narrowIndexTypeSuffixes[ep.narrowIndexType],pixelType,pixelFormat!=PIXEL_FORMAT_RGBA ? "8" : "","palette");
+                WriteRectUsage(f,*ei->usageRect,narrowIndexTypeNames[ep.narrowIndexType],narrowIndexTypeSuffixes[ep.narrowIndexType],pixelType,pixelFormat!=PIXEL_FORMAT_RGBA ? "8" : "","palette");
+                if (indexOutputOptionUsed && ei->usageIndices && strcmp(pixelType,outputIndexType)!=0) {   // (palette==NULL writes the indices)
+                    WriteRectUsage(f,*decodeRectUsage,narrowIndexTypeNames[ep.narrowIndexType],narrowIndexTypeSuffixes[ep.narrowIndexType],outputIndexType,numPaletteColors<=256 ? "8" : "16","NULL");
+                    WriteRectUsage(f,*ei->usageRect,narrowIndexTypeNames[ep.narrowIndexType],narrowIndexTypeSuffixes[ep.narrowIndexType],outputIndexType,numPaletteColors<=256 ? "8" : "16","NULL");
+                }
+            }
+        }
+        OutPrintf(f,"\n#endif //USAGE\n\n");
+#       endif
+    }
+
+    bytesOut = numBytesOut;
+    if (f!=stdout) fclose(f);
+    else fflush(f);
+    f=NULL;
+    TraceEnd(span);
+    //printf("\"%s\" -> \"%s\"OK\n",filename,savename);
+
+cleanup:
+    if (f && f!=stdout) {fclose(f);remove(savename);}  // (only a partial .inl file is still open here)
+    f=NULL;
+    if (blocks) {free(blocks);blocks=NULL;}
+    if (pIndices) {free(pIndices);pIndices=NULL;}
+    if (paletted.indices) {free(paletted.indices);paletted.indices=NULL;}
+    if (variantColors) {free(variantColors);variantColors=NULL;}
+    if (tileset.tilemap) {free(tileset.tilemap);tileset.tilemap=NULL;}
+    if (raw) {STBI_FREE(raw);raw=NULL;}
+    if (palette!=paletteEntries) {free(palette);palette=NULL;}
+    ReportStats(msg,statsOptionUsed,tracePath,bytesIn,ret==0 ? bytesOut : -1);
+    return ret;
 }
 
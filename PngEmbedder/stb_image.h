@@ -229,6 +229,10 @@ RECENT REVISION HISTORY:
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
 //
+// The PNG decoder also uses these SSE2/NEON kernels to unfilter 8-bit RGB
+// and RGBA rows; on x86 the Up filter also has an AVX2 kernel, selected at
+// run-time (define STBI_NO_AVX2 to leave it out).
+//
 // If for some reason you do not want to use any of SIMD code, or if
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
@@ -695,7 +699,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -706,7 +710,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -719,6 +723,37 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 (PNG unfiltering only): compiled for a separate target and selected at run-time,
+// define STBI_NO_AVX2 to disable it
+#if defined(STBI_SSE2) && !defined(STBI_NO_PNG) && !defined(STBI_NO_AVX2)
+#if defined(_MSC_VER) && _MSC_VER >= 1700
+#define STBI__PNG_AVX2
+#define STBI__AVX2_TARGET
+#elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define STBI__PNG_AVX2
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifdef STBI__PNG_AVX2
+#include <immintrin.h>
+static int stbi__avx2_available(void)
+{
+#ifdef _MSC_VER
+   int info[4];
+   __cpuid(info, 0);
+   if (info[0] < 7) return 0;
+   __cpuid(info, 1);
+   if (((info[2] >> 27) & 1) == 0 || ((info[2] >> 28) & 1) == 0) return 0; // OSXSAVE and AVX
+   if ((_xgetbv(0) & 6) != 6) return 0; // the OS saves the YMM registers
+   __cpuidex(info, 7, 0);
+   return ((info[1] >> 5) & 1) != 0;
+#else
+   return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -3930,6 +3965,9 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 //      - all output is written to a single output buffer (can malloc/realloc)
 //    performance
 //      - fast huffman
+//      - 64-bit bit buffer refilled 7 bytes at a time
+//      - literal/length lookups that can decode two literals at once
+//      - 8-byte match copies
 
 #ifndef STBI_NO_ZLIB
 
@@ -3937,6 +3975,19 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 
+// literal/length lookup of the inner loop: every entry has the first symbol (9 bits), an optional
+// second literal (8 bits), the length of the first code (4 bits), the total length (5 bits) and the
+// number of literals (2 bits: 0 if the first symbol is a length or the end of the block).
+// Zero entries (codes longer than STBI__ZLIT_BITS) use stbi__zhuffman_decode(...)
+#define STBI__ZLIT_BITS   11
+#define STBI__ZLIT_MASK   ((1 << STBI__ZLIT_BITS) - 1)
+
+#ifdef _MSC_VER
+typedef unsigned __int64 stbi__zbits;
+#else
+typedef unsigned long long stbi__zbits;
+#endif
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -4013,6 +4064,42 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
    return 1;
 }
 
+static void stbi__zbuild_fastlit(stbi__uint32 *fastlit, const stbi_uc *sizelist, int num)
+{
+   int i,s,j,code,sizes[17],next_code[16];
+   memset(sizes, 0, sizeof(sizes));
+   memset(fastlit, 0, sizeof(fastlit[0]) << STBI__ZLIT_BITS);
+   for (i=0; i < num; ++i)
+      ++sizes[sizelist[i]];
+   sizes[0] = 0;
+   code = 0;
+   for (i=1; i < 16; ++i) {
+      next_code[i] = code;
+      code = (code + sizes[i]) << 1;
+   }
+   // single symbols (stbi__zbuild_huffman(...) already validated the code lengths)
+   for (i=0; i < num; ++i) {
+      s = sizelist[i];
+      if (s) {
+         if (s <= STBI__ZLIT_BITS) {
+            stbi__uint32 e = (stbi__uint32) i | ((stbi__uint32) s << 17) | ((stbi__uint32) s << 21) | ((stbi__uint32) (i < 256) << 26);
+            for (j = stbi__bit_reverse(next_code[s],s); j < (1 << STBI__ZLIT_BITS); j += (1 << s))
+               fastlit[j] = e;
+         }
+         ++next_code[s];
+      }
+   }
+   // a literal followed by another literal whose code fits in the remaining bits
+   for (j=0; j < (1 << STBI__ZLIT_BITS); ++j) {
+      stbi__uint32 e = fastlit[j], e2;
+      int len1 = (int) ((e >> 17) & 15);
+      if (!e || (e >> 26) != 1 || len1 >= STBI__ZLIT_BITS) continue;
+      e2 = fastlit[j >> len1];  // (only its first symbol is used)
+      if (!e2 || ((e2 >> 26) & 3) == 0 || (int) ((e2 >> 17) & 15) > STBI__ZLIT_BITS - len1) continue;
+      fastlit[j] = (e & 511) | ((e2 & 255) << 9) | ((stbi__uint32) len1 << 17) | ((stbi__uint32) (len1 + ((e2 >> 17) & 15)) << 21) | (2u << 26);
+   }
+}
+
 // zlib-from-memory implementation for PNG reading
 //    because PNG allows splitting the zlib stream arbitrarily,
 //    and it's annoying structurally to have PNG call ZLIB call PNG,
@@ -4023,7 +4110,8 @@ typedef struct
 {
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
-   stbi__uint32 code_buffer;
+   int num_past_end; // zero bytes added to code_buffer after zbuffer_end
+   stbi__zbits code_buffer; // (bits above num_bits can be the next input bytes)
 
    char *zout;
    char *zout_start;
@@ -4031,6 +4119,7 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+   stbi__uint32 z_fastlit[1 << STBI__ZLIT_BITS];
 } stbi__zbuf;
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
@@ -4041,18 +4130,29 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
 
 static void stbi__fill_bits(stbi__zbuf *z)
 {
+   if (z->zbuffer_end - z->zbuffer >= 8) {
+      // load 8 bytes but consume only the whole bytes that fit: the rest stays above num_bits
+      // and is OR'ed again (with the same value) by the next refill
+      stbi_uc *p = z->zbuffer;
+      stbi__zbits v = (stbi__zbits) p[0] | ((stbi__zbits) p[1] << 8) | ((stbi__zbits) p[2] << 16) | ((stbi__zbits) p[3] << 24) |
+                      ((stbi__zbits) p[4] << 32) | ((stbi__zbits) p[5] << 40) | ((stbi__zbits) p[6] << 48) | ((stbi__zbits) p[7] << 56);
+      z->code_buffer |= v << z->num_bits;
+      z->zbuffer += (63 - z->num_bits) >> 3;
+      z->num_bits |= 56;
+      return;
+   }
    do {
-      STBI_ASSERT(z->code_buffer < (1U << z->num_bits));
-      z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
+      if (z->zbuffer >= z->zbuffer_end) ++z->num_past_end;
+      z->code_buffer |= (stbi__zbits) stbi__zget8(z) << z->num_bits;
       z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   } while (z->num_bits < 56);
 }
 
 stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) stbi__fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) (z->code_buffer & ((1 << n) - 1));
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
@@ -4063,7 +4163,7 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -4080,7 +4180,7 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
 {
    int b,s;
    if (a->num_bits < 16) stbi__fill_bits(a);
-   b = z->fast[a->code_buffer & STBI__ZFAST_MASK];
+   b = z->fast[(int) (a->code_buffer & STBI__ZFAST_MASK)];
    if (b) {
       s = b >> 9;
       a->code_buffer >>= s;
@@ -4127,7 +4227,26 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+      stbi__uint32 e;
+      if (a->num_bits < 48) stbi__fill_bits(a); // enough for a length, a distance and their extra bits
+      e = a->z_fastlit[(int) (a->code_buffer & STBI__ZLIT_MASK)];
+      if ((e >> 26) == 2 && a->zout_end - zout >= 2) {
+         int n = (int) ((e >> 21) & 31);
+         zout[0] = (char) (e & 255);
+         zout[1] = (char) ((e >> 9) & 255);
+         zout += 2;
+         a->code_buffer >>= n;
+         a->num_bits -= n;
+         continue;
+      }
+      if (e) {
+         int n = (int) ((e >> 17) & 15);
+         z = (int) (e & 511);
+         a->code_buffer >>= n;
+         a->num_bits -= n;
+      } else
+         z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4156,8 +4275,18 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
          }
          p = (stbi_uc *) (zout - dist);
          if (dist == 1) { // run of one byte; common in images.
-            stbi_uc v = *p;
-            if (len) { do *zout++ = v; while (--len); }
+            memset(zout, *p, len);
+            zout += len;
+         } else if (dist >= 4 && a->z_expandable && a->zout_end - zout >= len + 8) {
+            // 8 (or 4) bytes at a time, never more than 'dist' so that every chunk is already there:
+            // this can write up to 7 bytes past the match, that are overwritten next or are past the
+            // decoded data
+            char *end = zout + len;
+            if (dist >= 8)
+               do { memcpy(zout, p, 8); zout += 8; p += 8; } while (zout < end);
+            else
+               do { memcpy(zout, p, 4); zout += 4; p += 4; } while (zout < end);
+            zout = end;
          } else {
             if (len) { do *zout++ = *p++; while (--len); }
          }
@@ -4211,6 +4340,7 @@ static int stbi__compute_huffman_codes(stbi__zbuf *a)
    if (n != ntot) return stbi__err("bad codelengths","Corrupt PNG");
    if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
    if (!stbi__zbuild_huffman(&a->z_distance, lencodes+hlit, hdist)) return 0;
+   stbi__zbuild_fastlit(a->z_fastlit, lencodes, hlit);
    return 1;
 }
 
@@ -4220,17 +4350,17 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
    int len,nlen,k;
    if (a->num_bits & 7)
       stbi__zreceive(a, a->num_bits & 7); // discard
-   // drain the bit-packed data into header
-   k = 0;
-   while (a->num_bits > 0) {
-      header[k++] = (stbi_uc) (a->code_buffer & 255); // suppress MSVC run-time check
-      a->code_buffer >>= 8;
-      a->num_bits -= 8;
-   }
-   STBI_ASSERT(a->num_bits == 0);
-   // now fill header the normal way
-   while (k < 4)
-      header[k++] = stbi__zget8(a);
+   // give back the whole bytes of the bit buffer (up to 7), then read the header the normal way.
+   // The top num_past_end bytes are zero padding (zbuffer did not move for them): only the
+   // bytes below it go back, and it's an error only if some padding was already consumed
+   k = (a->num_bits >> 3) - a->num_past_end;
+   if (k < 0) return stbi__err("read past buffer","Corrupt PNG");
+   a->zbuffer -= k;
+   a->num_past_end = 0;
+   a->num_bits = 0;
+   a->code_buffer = 0;
+   for (k=0; k < 4; ++k)
+      header[k] = stbi__zget8(a);
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
@@ -4291,6 +4421,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
    if (parse_header)
       if (!stbi__parse_zlib_header(a)) return 0;
    a->num_bits = 0;
+   a->num_past_end = 0;
    a->code_buffer = 0;
    do {
       final = stbi__zreceive(a,1);
@@ -4304,6 +4435,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
             // use fixed code lengths
             if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , 288)) return 0;
             if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
+            stbi__zbuild_fastlit(a->z_fastlit, stbi__zdefault_length, 288);
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
@@ -4472,6 +4604,221 @@ static int stbi__paeth(int a, int b, int c)
    return c;
 }
 
+// SIMD unfiltering of 8-bit rows with 3 or 4 channels (including the 3->4 expansion that
+// adds an opaque alpha channel). Sub, Avg and Paeth depend on the pixel to the left, so
+// they process one pixel per step with all its channels in parallel; Up has no such
+// dependency and runs 16 (or 32 with AVX2) bytes at a time. The results are bit-identical
+// to the scalar code below, which is still used for all the other rows.
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+#define STBI__PNG_SIMD
+#endif
+
+#ifdef STBI_SSE2
+static stbi_inline __m128i stbi__png_load_px_sse2(const stbi_uc *p, int n)
+{
+   stbi__uint32 v = 0;
+   if (n == 4) memcpy(&v, p, 4); else memcpy(&v, p, 3);
+   return _mm_cvtsi32_si128((int) v);
+}
+
+static stbi_inline void stbi__png_store_px_sse2(stbi_uc *p, __m128i x, int n)
+{
+   stbi__uint32 v = (stbi__uint32) _mm_cvtsi128_si32(x);
+   if (n == 4) memcpy(p, &v, 4); else memcpy(p, &v, 3);
+}
+
+#ifdef STBI__PNG_AVX2
+STBI__AVX2_TARGET static void stbi__png_unfilter_up_avx2(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, stbi__uint32 n)
+{
+   stbi__uint32 k = 0;
+   for (; k + 32 <= n; k += 32) {
+      __m256i r = _mm256_loadu_si256((const __m256i *) (raw + k));
+      __m256i p = _mm256_loadu_si256((const __m256i *) (prior + k));
+      _mm256_storeu_si256((__m256i *) (cur + k), _mm256_add_epi8(r, p));
+   }
+   for (; k < n; ++k) cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+#endif
+
+// unfilters pixels 1..count of a row (pixel 0 is already done); returns 0 if it can't
+static int stbi__png_unfilter_row_sse2(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, stbi__uint32 count, int filter, int img_n, int out_n, int avx2)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i ones = _mm_set1_epi8(1);
+   __m128i a, b, c, d;
+   stbi__uint32 i;
+   int n;
+
+   if (img_n < 3 || count == 0) return 0;
+
+   if (filter == STBI__F_up && img_n == out_n) {
+      stbi__uint32 k = 0, nk = count * img_n;
+#ifdef STBI__PNG_AVX2
+      if (avx2) {
+         stbi__png_unfilter_up_avx2(cur, prior, raw, nk);
+         return 1;
+      }
+#endif
+      STBI_NOTUSED(avx2);
+      for (; k + 16 <= nk; k += 16) {
+         __m128i r = _mm_loadu_si128((const __m128i *) (raw + k));
+         __m128i p = _mm_loadu_si128((const __m128i *) (prior + k));
+         _mm_storeu_si128((__m128i *) (cur + k), _mm_add_epi8(r, p));
+      }
+      for (; k < nk; ++k) cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      return 1;
+   }
+   STBI_NOTUSED(avx2);
+
+   // 4-byte loads and stores except for the last pixel (a 3-byte store spills into the next
+   // pixel, which is written right after)
+   a = stbi__png_load_px_sse2(cur - out_n, img_n);
+   switch (filter) {
+      case STBI__F_sub:
+         for (i=0; i < count; ++i, raw += img_n, cur += out_n) {
+            n = i + 1 < count ? 4 : img_n;
+            a = _mm_add_epi8(stbi__png_load_px_sse2(raw, n), a);
+            stbi__png_store_px_sse2(cur, a, out_n == img_n ? n : 4);
+            if (out_n != img_n) cur[3] = 255;
+         }
+         break;
+      case STBI__F_up:
+         for (i=0; i < count; ++i, raw += img_n, cur += out_n, prior += out_n) {
+            n = i + 1 < count ? 4 : img_n;
+            a = _mm_add_epi8(stbi__png_load_px_sse2(raw, n), stbi__png_load_px_sse2(prior, n));
+            stbi__png_store_px_sse2(cur, a, out_n == img_n ? n : 4);
+            if (out_n != img_n) cur[3] = 255;
+         }
+         break;
+      case STBI__F_avg:
+         for (i=0; i < count; ++i, raw += img_n, cur += out_n, prior += out_n) {
+            n = i + 1 < count ? 4 : img_n;
+            b = stbi__png_load_px_sse2(prior, n);
+            // (a+b)>>1 without overflow: pavgb rounds up, so subtract the lost bit
+            d = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), ones));
+            a = _mm_add_epi8(stbi__png_load_px_sse2(raw, n), d);
+            stbi__png_store_px_sse2(cur, a, out_n == img_n ? n : 4);
+            if (out_n != img_n) cur[3] = 255;
+         }
+         break;
+      case STBI__F_paeth:
+         c = _mm_unpacklo_epi8(stbi__png_load_px_sse2(prior - out_n, img_n), zero);
+         for (i=0; i < count; ++i, raw += img_n, cur += out_n, prior += out_n) {
+            __m128i pa, pb, pc, smallest, a16, use_a, use_b;
+            n = i + 1 < count ? 4 : img_n;
+            a16 = _mm_unpacklo_epi8(a, zero);
+            b = _mm_unpacklo_epi8(stbi__png_load_px_sse2(prior, n), zero);
+            pa = _mm_sub_epi16(b, c);        // p-a
+            pb = _mm_sub_epi16(a16, c);      // p-b
+            pc = _mm_add_epi16(pa, pb);      // p-c
+            pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+            pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+            pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+            smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            // same ties as stbi__paeth: a, then b, then c
+            use_a = _mm_cmpeq_epi16(smallest, pa);
+            use_b = _mm_cmpeq_epi16(smallest, pb);
+            d = _mm_or_si128(_mm_and_si128(use_b, b), _mm_andnot_si128(use_b, c));
+            d = _mm_or_si128(_mm_and_si128(use_a, a16), _mm_andnot_si128(use_a, d));
+            a = _mm_add_epi8(stbi__png_load_px_sse2(raw, n), _mm_packus_epi16(d, d));
+            stbi__png_store_px_sse2(cur, a, out_n == img_n ? n : 4);
+            if (out_n != img_n) cur[3] = 255;
+            c = b;
+         }
+         break;
+      default:
+         return 0;
+   }
+   return 1;
+}
+#endif // STBI_SSE2
+
+#ifdef STBI_NEON
+static stbi_inline uint8x8_t stbi__png_load_px_neon(const stbi_uc *p, int n)
+{
+   stbi__uint32 v = 0;
+   if (n == 4) memcpy(&v, p, 4); else memcpy(&v, p, 3);
+   return vreinterpret_u8_u32(vdup_n_u32(v));
+}
+
+static stbi_inline void stbi__png_store_px_neon(stbi_uc *p, uint8x8_t x, int n)
+{
+   stbi__uint32 v = vget_lane_u32(vreinterpret_u32_u8(x), 0);
+   if (n == 4) memcpy(p, &v, 4); else memcpy(p, &v, 3);
+}
+
+// unfilters pixels 1..count of a row (pixel 0 is already done); returns 0 if it can't
+static int stbi__png_unfilter_row_neon(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, stbi__uint32 count, int filter, int img_n, int out_n)
+{
+   uint8x8_t a, b, c;
+   stbi__uint32 i;
+   int n;
+
+   if (img_n < 3 || count == 0) return 0;
+
+   if (filter == STBI__F_up && img_n == out_n) {
+      stbi__uint32 k = 0, nk = count * img_n;
+      for (; k + 16 <= nk; k += 16)
+         vst1q_u8(cur + k, vaddq_u8(vld1q_u8(raw + k), vld1q_u8(prior + k)));
+      for (; k < nk; ++k) cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      return 1;
+   }
+
+   // 4-byte loads and stores except for the last pixel (a 3-byte store spills into the next
+   // pixel, which is written right after)
+   a = stbi__png_load_px_neon(cur - out_n, img_n);
+   switch (filter) {
+      case STBI__F_sub:
+         for (i=0; i < count; ++i, raw += img_n, cur += out_n) {
+            n = i + 1 < count ? 4 : img_n;
+            a = vadd_u8(stbi__png_load_px_neon(raw, n), a);
+            stbi__png_store_px_neon(cur, a, out_n == img_n ? n : 4);
+            if (out_n != img_n) cur[3] = 255;
+         }
+         break;
+      case STBI__F_up:
+         for (i=0; i < count; ++i, raw += img_n, cur += out_n, prior += out_n) {
+            n = i + 1 < count ? 4 : img_n;
+            a = vadd_u8(stbi__png_load_px_neon(raw, n), stbi__png_load_px_neon(prior, n));
+            stbi__png_store_px_neon(cur, a, out_n == img_n ? n : 4);
+            if (out_n != img_n) cur[3] = 255;
+         }
+         break;
+      case STBI__F_avg:
+         for (i=0; i < count; ++i, raw += img_n, cur += out_n, prior += out_n) {
+            n = i + 1 < count ? 4 : img_n;
+            b = stbi__png_load_px_neon(prior, n);
+            a = vadd_u8(stbi__png_load_px_neon(raw, n), vhadd_u8(a, b));
+            stbi__png_store_px_neon(cur, a, out_n == img_n ? n : 4);
+            if (out_n != img_n) cur[3] = 255;
+         }
+         break;
+      case STBI__F_paeth:
+         c = stbi__png_load_px_neon(prior - out_n, img_n);
+         for (i=0; i < count; ++i, raw += img_n, cur += out_n, prior += out_n) {
+            uint16x8_t pa, pb, pc;
+            uint8x8_t use_a, use_b;
+            n = i + 1 < count ? 4 : img_n;
+            b = stbi__png_load_px_neon(prior, n);
+            pa = vabdl_u8(b, c);                                 // |p-a|
+            pb = vabdl_u8(a, c);                                 // |p-b|
+            pc = vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c));      // |p-c|
+            // same ties as stbi__paeth: a, then b, then c
+            use_a = vmovn_u16(vandq_u16(vcleq_u16(pa, pb), vcleq_u16(pa, pc)));
+            use_b = vmovn_u16(vcleq_u16(pb, pc));
+            a = vadd_u8(stbi__png_load_px_neon(raw, n), vbsl_u8(use_a, a, vbsl_u8(use_b, b, c)));
+            stbi__png_store_px_neon(cur, a, out_n == img_n ? n : 4);
+            if (out_n != img_n) cur[3] = 255;
+            c = b;
+         }
+         break;
+      default:
+         return 0;
+   }
+   return 1;
+}
+#endif // STBI_NEON
+
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
 // create the png data from post-deflated data
@@ -4487,6 +4834,14 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
    int width = x;
+#ifdef STBI_SSE2
+   int sse2 = stbi__sse2_available();
+#ifdef STBI__PNG_AVX2
+   int avx2 = sse2 && stbi__avx2_available();
+#else
+   int avx2 = 0;
+#endif
+#endif
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
    a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
@@ -4553,6 +4908,19 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          prior += 1;
       }
 
+#ifdef STBI__PNG_SIMD
+      if (depth == 8) {
+#ifdef STBI_SSE2
+         if (sse2 && stbi__png_unfilter_row_sse2(cur, prior, raw, x-1, filter, img_n, out_n, avx2)) {
+#else
+         if (stbi__png_unfilter_row_neon(cur, prior, raw, x-1, filter, img_n, out_n)) {
+#endif
+            raw += (x-1)*img_n;
+            continue;
+         }
+      }
+#endif
+
       // this is a little gross, so that we don't switch per-pixel or per-component
       if (depth < 8 || img_n == out_n) {
          int nk = (width - 1)*filter_bytes;
@@ -78,6 +78,8 @@ int kbhit() {
 
     return (byteswaiting > 0) ? 1 : 0;
 }
+#   include <time.h>           // clock_gettime (used by --stats and --trace)
+#   include <sys/resource.h>   // getrusage
 #   ifdef __EMSCRIPTEN__
 #      include <emscripten.h>
 #      define sleep_ms(X)      emscripten_sleep(X)     // needs -s ASYNCIFY=1 [simply using usleep(...) compiles but does not work correctly]
@@ -138,11 +140,80 @@ static __inline void displayValueUpdated(snoat value)  {
 }
 
 
+// Phase timings (for --stats and --trace): every call to traceBegin(...)/traceEnd(...) becomes a span
+#ifndef MAX_NUM_TRACE_SPANS
+#   define MAX_NUM_TRACE_SPANS (4096)
+#endif
+struct traceSpan_t {const char* name;double startMs,durationMs;};
+static struct traceSpan_t traceSpans[MAX_NUM_TRACE_SPANS];
+static int numTraceSpans = 0;
+static size_t traceBytesIn = 0, traceBytesOut = 0;    // last captured sound (in bytes) and last saved .inl file
+static double getTimeMs(void)   {
+#   ifdef _WIN32
+    LARGE_INTEGER counter,frequency;
+    QueryPerformanceCounter(&counter);QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart*1000.0/(double)frequency.QuadPart;
+#   else
+    struct timespec ts;clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec*1000.0+(double)ts.tv_nsec/1000000.0;
+#   endif
+}
+static int traceBegin(const char* name) {
+    struct traceSpan_t* ts;
+    if (numTraceSpans>=MAX_NUM_TRACE_SPANS) return -1;    // further spans are dropped
+    ts = &traceSpans[numTraceSpans];
+    ts->name=name;ts->durationMs=0;ts->startMs=getTimeMs();
+    return numTraceSpans++;
+}
+static __inline void traceEnd(int span)  {if (span>=0) traceSpans[span].durationMs = getTimeMs()-traceSpans[span].startMs;}
+static long getPeakRSSKb(void)  {
+#   if (!defined(_WIN32) && !defined(__EMSCRIPTEN__))
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF,&ru)!=0) return 0;
+#       ifdef __APPLE__
+    return (long) (ru.ru_maxrss/1024);
+#       else
+    return (long) ru.ru_maxrss;
+#       endif
+#   else
+    return 0;   // unknown
+#   endif
+}
+static int writeTraceFile(const char* path)    {
+    int i;FILE* f = fopen(path,"wt");
+    if (!f) return 0;
+    fprintf(f,"{\"traceEvents\":[\n");
+    for (i=0;i<numTraceSpans;i++) {
+        const struct traceSpan_t* ts = &traceSpans[i];
+        fprintf(f,"{\"name\":\"%s\",\"cat\":\"sndEmbedder\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}%s\n",
+                ts->name,(ts->startMs-traceSpans[0].startMs)*1000.0,ts->durationMs*1000.0,i<numTraceSpans-1?",":"");
+    }
+    fprintf(f,"],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+    return 1;
+}
+static void printStats(void)    {
+    // The same phase usually runs many times (e.g. while tuning params): we print the totals
+    int i,j;const long peakRSSKb = getPeakRSSKb();
+    printf("%-12s %6s %12s\n","PHASE","COUNT","TOTAL (ms)");
+    for (i=0;i<numTraceSpans;i++) {
+        int count = 0;double totalMs = 0;
+        for (j=0;j<i;j++) if (strcmp(traceSpans[j].name,traceSpans[i].name)==0) break;
+        if (j<i) continue;  // already printed
+        for (j=i;j<numTraceSpans;j++) if (strcmp(traceSpans[j].name,traceSpans[i].name)==0) {++count;totalMs+=traceSpans[j].durationMs;}
+        printf("%-12s %6d %12.3f\n",traceSpans[i].name,count,totalMs);
+    }
+    printf("Bytes in: %lu  Bytes out: %lu",(unsigned long)traceBytesIn,(unsigned long)traceBytesOut);
+    if (peakRSSKb>0) printf("  Peak RSS: %ld Kb",peakRSSKb);
+    printf("\n");
+}
+
 
 
 
 int main(int argc,char* argv[]) {
-    struct sndcontext_t* c = sndcontext_create();
+    struct sndcontext_t* c = NULL;
+    const char* tracePath = NULL;int statsOptionUsed = 0, span = -1;
 #   ifndef CAPTURE_BUFFER_SIZE
 #       define CAPTURE_BUFFER_SIZE (1<<17)   // Example: (4096)/22050 = 0,185759637 s
 #   endif
@@ -155,6 +226,21 @@ int main(int argc,char* argv[]) {
     if (sleepAmountMs<1) sleepAmountMs=1;
     else if (sleepAmountMs>50) sleepAmountMs=50;
 
+    {
+        int i;
+        for (i=1;i<argc;i++) {
+            if (strcmp(argv[i],"--stats")==0) statsOptionUsed = 1;
+            else if (strcmp(argv[i],"--trace")==0 && i+1<argc) tracePath = argv[++i];
+            else {
+                printf("USAGE: sndEmbedder [--stats] [--trace out.json]\n");
+                printf("  --stats           print the time spent in each phase, bytes in and out and peak memory usage at exit\n");
+                printf("  --trace out.json  save the phase timings as Chrome trace-event JSON at exit\n");
+                return -1;
+            }
+        }
+    }
+    c = sndcontext_create();
+
 #   ifndef LOG2_CAPTURE_BUFFER_SIZE_NEXT_POT
 #       define LOG2_CAPTURE_BUFFER_SIZE_NEXT_POT (17)
 #   endif
@@ -243,6 +329,7 @@ int main(int argc,char* argv[]) {
             playbackDeviceStarted = sndcontext_isOpenPlaybackDeviceStarted(c);
 
             //--- Extract valid sound chunk (trimming silence) ----
+            span = traceBegin("trim");
             startCaptureSample=0;endCaptureSample=CAPTURE_BUFFER_SIZE;detectedSoundDurationMs = CAPTURE_BUFFER_DURATION_MS;
             captureSampleLength = (endCaptureSample-startCaptureSample);
 
@@ -259,6 +346,7 @@ int main(int argc,char* argv[]) {
             if (startCaptureSample>=endCaptureSample)   {startCaptureSample=0;endCaptureSample=CAPTURE_BUFFER_SIZE;}
             captureSampleLength = (endCaptureSample-startCaptureSample);
             detectedSoundDurationMs = (1000*captureSampleLength/SND_SAMPLERATE);
+            traceEnd(span);traceBytesIn = captureSampleLength*sizeof(snoat);
             //-----------------------------------------------------
 
             do  {
@@ -346,21 +434,29 @@ int main(int argc,char* argv[]) {
                     // DFT:
                     for (i=0;i<captureSampleLength;i++)    {dft_input[i][0]=captureBuffer[i+startCaptureSample];dft_input[i][1]=0;}  // fill dft_input
                     for (i=captureSampleLength;i<dft_size_pot;i++)    {dft_input[i][0]=dft_input[i][1]=0;}  // Pad the rest with zero
+                    span = traceBegin("dft");
                     snd_DiscreteFourierTransform(dft_output,dft_input,dft_size_pot,dft_log2size,0,0);
+                    traceEnd(span);
 
                     // DFT serialize
 
                     serializeBufferSize = 0;
+                    span = traceBegin("serialize");
                     serializeBuffer = snd_SerializeDiscreteFourierTransform(&serializeBufferSize,captureSampleLength,dft_output,&params);
+                    traceEnd(span);
                     SND_ASSERT(serializeBuffer && serializeBufferSize>0);
                     //------------------
+                    span = traceBegin("deserialize");
                     check_size = snd_DeserializeDiscreteFourierTransform(dft_output2,dft_size_pot,serializeBuffer,serializeBufferSize);
+                    traceEnd(span);
 
                     SND_ASSERT(check_size==(size_t)dft_size_pot);
                     SND_FREE(serializeBuffer);serializeBuffer=NULL;
 
                     // IDFT:
+                    span = traceBegin("idft");
                     snd_DiscreteFourierTransform(dft_input,dft_output2,dft_size_pot,dft_log2size,1,0);          // Note that output 'dft_input' should be real (we don't check)
+                    traceEnd(span);
                     for (i=0;i<captureSampleLength;i++)    {captureBufferReconstructed[i] = dft_input[i][0];}  // fill captureBufferReconstructed
 
                     //-------------------------------------------------------------------------------
@@ -524,12 +620,18 @@ int main(int argc,char* argv[]) {
                                     // update playback (better refactor)
                                     sndcontext_playbackStop(c);
                                     SND_ASSERT(serializeBuffer==NULL);
+                                    span = traceBegin("serialize");
                                     serializeBuffer = snd_SerializeDiscreteFourierTransform(&serializeBufferSize,captureSampleLength,dft_output,&params);
+                                    traceEnd(span);
                                     SND_ASSERT(serializeBuffer && serializeBufferSize>0);
+                                    span = traceBegin("deserialize");
                                     check_size = snd_DeserializeDiscreteFourierTransform(dft_output2,dft_size_pot,serializeBuffer,serializeBufferSize);
+                                    traceEnd(span);
                                     SND_ASSERT(check_size==(size_t)dft_size_pot);
                                     SND_FREE(serializeBuffer);serializeBuffer=NULL;
+                                    span = traceBegin("idft");
                                     snd_DiscreteFourierTransform(dft_input,dft_output2,dft_size_pot,dft_log2size,1,0);          // Note that output 'dft_input' should be real (we don't check)
+                                    traceEnd(span);
                                     for (i=0;i<captureSampleLength;i++)    {captureBufferReconstructed[i] = dft_input[i][0];}  // fill captureBufferReconstructed
                                     sndcontext_feedPlaybackData(c,&captureBufferReconstructed[0],captureSampleLength*sizeof(snoat));
                                     sndcontext_playbackPlay(c);
@@ -559,17 +661,21 @@ int main(int argc,char* argv[]) {
                                 if (ch4=='2' || ch4=='3')   {
                                     SND_ASSERT(!serializeBuffer);
                                     serializeBufferSize = 0;
+                                    span = traceBegin("serialize");
                                     serializeBuffer = snd_SerializeDiscreteFourierTransform(&serializeBufferSize,captureSampleLength,dft_output,&params);
+                                    traceEnd(span);
                                     SND_ASSERT(serializeBuffer && serializeBufferSize>0);
                                     if (ch4=='2')   {
                                         char* buff = NULL; size_t buff_size=0,size=0;FILE* f = NULL;
                                         strcat(filename,".inl");
+                                        span = traceBegin("base85");
                                         size = snd_Base85Encode((const char*)serializeBuffer,serializeBufferSize,&buff,&buff_size,1,280,1);
+                                        traceEnd(span);
                                         SND_ASSERT(buff);
                                         f = fopen(filename,"wt");
                                         if (f)  {
-                                            fprintf(f,"\t// num_samples = %d, saved with samplerate = %d and num_channels = %d (length in ms: %d)\n",captureSampleLength,SND_SAMPLERATE,1,detectedSoundDurationMs);
-                                            fwrite(buff,size,1,f);
+                                            const int n = fprintf(f,"\t// num_samples = %d, saved with samplerate = %d and num_channels = %d (length in ms: %d)\n",captureSampleLength,SND_SAMPLERATE,1,detectedSoundDurationMs);
+                                            traceBytesOut = (n>0 ? (size_t)n : 0)+fwrite(buff,1,size,f);  // (counted: ftell(...) means nothing for devices)
                                             fclose(f);
                                             printf("\nFile: \"%s\" saved successfully.\n",filename);
                                         }
@@ -580,7 +686,7 @@ int main(int argc,char* argv[]) {
                                         strcat(filename,".bin");
                                         f = fopen(filename,"wt");
                                         if (f)  {
-                                            fwrite(serializeBuffer,serializeBufferSize,1,f);
+                                            traceBytesOut = fwrite(serializeBuffer,1,serializeBufferSize,f);
                                             fclose(f);
                                             printf("\nFile: \"%s\" saved successfully.\n",filename);
                                         }
@@ -643,6 +749,8 @@ int main(int argc,char* argv[]) {
 
     fflush(stdout);
     sndcontext_destroy(c);c=NULL;
+    if (statsOptionUsed) printStats();
+    if (tracePath && !writeTraceFile(tracePath)) printf("Error: cannot save file: \"%s\".\n",tracePath);
     return 0;
 }
 